@@ -18,26 +18,26 @@ U64 BB_KING_ATTACKS[64];
 
 U64 BB_HORIZONTAL[8] =
 {
-	LL(0xff00000000000000),
-	LL(0x00ff000000000000),
-	LL(0x0000ff0000000000),
-	LL(0x000000ff00000000),
-	LL(0x00000000ff000000),
-	LL(0x0000000000ff0000),
+	LL(0x00000000000000ff),
 	LL(0x000000000000ff00),
-	LL(0x00000000000000ff)
+	LL(0x0000000000ff0000),
+	LL(0x00000000ff000000),
+	LL(0x000000ff00000000),
+	LL(0x0000ff0000000000),
+	LL(0x00ff000000000000),
+	LL(0xff00000000000000)
 };
 
 U64 BB_VERTICAL[8] =
 {
-	LL(0x8080808080808080),
-	LL(0x4040404040404040),
-	LL(0x2020202020202020),
-	LL(0x1010101010101010),
-	LL(0x0808080808080808),
-	LL(0x0404040404040404),
+	LL(0x0101010101010101),
 	LL(0x0202020202020202),
-	LL(0x0101010101010101)
+	LL(0x0404040404040404),
+	LL(0x0808080808080808),
+	LL(0x1010101010101010),
+	LL(0x2020202020202020),
+	LL(0x4040404040404040),
+	LL(0x8080808080808080)
 };
 
 U64 BB_FIRST_HORIZONTAL[2]   = { BB_HORIZONTAL[7], BB_HORIZONTAL[0] };
@@ -51,22 +51,22 @@ U64 BB_EIGHTH_HORIZONTAL[2]  = { BB_HORIZONTAL[0], BB_HORIZONTAL[7] };
 
 static const U64 B_MASK[64] =
 {
-	LL(0x0040201008040200), LL(0x0020100804020000), LL(0x0050080402000000), LL(0x0028440200000000),
-	LL(0x0014224000000000), LL(0x000a102040000000), LL(0x0004081020400000), LL(0x0002040810204000),
-	LL(0x0000402010080400), LL(0x0000201008040200), LL(0x0000500804020000), LL(0x0000284402000000),
-	LL(0x0000142240000000), LL(0x00000a1020400000), LL(0x0000040810204000), LL(0x0000020408102000),
-	LL(0x0040004020100800), LL(0x0020002010080400), LL(0x0050005008040200), LL(0x0028002844020000),
-	LL(0x0014001422400000), LL(0x000a000a10204000), LL(0x0004000408102000), LL(0x0002000204081000),
-	LL(0x0020400040201000), LL(0x0010200020100800), LL(0x0008500050080400), LL(0x0044280028440200),
-	LL(0x0022140014224000), LL(0x00100a000a102000), LL(0x0008040004081000), LL(0x0004020002040800),
-	LL(0x0010204000402000), LL(0x0008102000201000), LL(0x0004085000500800), LL(0x0002442800284400),
-	LL(0x0040221400142200), LL(0x0020100a000a1000), LL(0x0010080400040800), LL(0x0008040200020400),
-	LL(0x0008102040004000), LL(0x0004081020002000), LL(0x0002040850005000), LL(0x0000024428002800),
-	LL(0x0000402214001400), LL(0x004020100a000a00), LL(0x0020100804000400), LL(0x0010080402000200),
-	LL(0x0004081020400000), LL(0x0002040810200000), LL(0x0000020408500000), LL(0x0000000244280000),
-	LL(0x0000004022140000), LL(0x00004020100a0000), LL(0x0040201008040000), LL(0x0020100804020000),
-	LL(0x0002040810204000), LL(0x0000020408102000), LL(0x0000000204085000), LL(0x0000000002442800),
-	LL(0x0000000040221400), LL(0x0000004020100a00), LL(0x0000402010080400), LL(0x0040201008040200)
+	LL(0x0040201008040200), LL(0x0000402010080400), LL(0x0000004020100a00), LL(0x0000000040221400),
+	LL(0x0000000002442800), LL(0x0000000204085000), LL(0x0000020408102000), LL(0x0002040810204000),
+	LL(0x0020100804020000), LL(0x0040201008040000), LL(0x00004020100a0000), LL(0x0000004022140000),
+	LL(0x0000000244280000), LL(0x0000020408500000), LL(0x0002040810200000), LL(0x0004081020400000),
+	LL(0x0010080402000200), LL(0x0020100804000400), LL(0x004020100a000a00), LL(0x0000402214001400),
+	LL(0x0000024428002800), LL(0x0002040850005000), LL(0x0004081020002000), LL(0x0008102040004000),
+	LL(0x0008040200020400), LL(0x0010080400040800), LL(0x0020100a000a1000), LL(0x0040221400142200),
+	LL(0x0002442800284400), LL(0x0004085000500800), LL(0x0008102000201000), LL(0x0010204000402000),
+	LL(0x0004020002040800), LL(0x0008040004081000), LL(0x00100a000a102000), LL(0x0022140014224000),
+	LL(0x0044280028440200), LL(0x0008500050080400), LL(0x0010200020100800), LL(0x0020400040201000),
+	LL(0x0002000204081000), LL(0x0004000408102000), LL(0x000a000a10204000), LL(0x0014001422400000),
+	LL(0x0028002844020000), LL(0x0050005008040200), LL(0x0020002010080400), LL(0x0040004020100800),
+	LL(0x0000020408102000), LL(0x0000040810204000), LL(0x00000a1020400000), LL(0x0000142240000000),
+	LL(0x0000284402000000), LL(0x0000500804020000), LL(0x0000201008040200), LL(0x0000402010080400),
+	LL(0x0002040810204000), LL(0x0004081020400000), LL(0x000a102040000000), LL(0x0014224000000000),
+	LL(0x0028440200000000), LL(0x0050080402000000), LL(0x0020100804020000), LL(0x0040201008040200)
 };
 
 static const int B_BITS[64] =
@@ -95,42 +95,42 @@ static const int B_SHIFT[64] =
 
 static const U64 B_MULT[64] =
 {
-	LL(0x0040010202020020), LL(0x0800080801080200), LL(0x4000000802080600), LL(0x1040010010020200),
-	LL(0x0800000400841400), LL(0x0081000021080800), LL(0x000000208404a000), LL(0x0001010100a00400),
-	LL(0x0008020802006000), LL(0x0020021022008000), LL(0x0040401002048000), LL(0x0004000420820100),
-	LL(0x020400020a020000), LL(0x1800002108080000), LL(0x0000804410044000), LL(0x0002011012100000),
-	LL(0x8001010401000080), LL(0x0002040800800201), LL(0x0001010101004200), LL(0x004002020a000400),
-	LL(0x0001204200800800), LL(0x0402020022000400), LL(0x0004030110000800), LL(0x2008040220000800),
-	LL(0x0008004880010080), LL(0x0010040840008200), LL(0x0002020201004800), LL(0x00040100100400c0),
-	LL(0x00c0020080080080), LL(0x0002010440100040), LL(0x0804100200040400), LL(0x8008201000080200),
-	LL(0x0002028000208800), LL(0x0001040000420802), LL(0x0042020000480200), LL(0x0002840000822000),
-	LL(0x0021004004040002), LL(0x0002440008002400), LL(0x4002020020040400), LL(0x0002200008208400),
-	LL(0x0000400205008800), LL(0x0002000108010c00), LL(0x0000200410080810), LL(0x0001008090400100),
-	LL(0x0048000082004100), LL(0x0010001800202020), LL(0x0003001010020080), LL(0x1004001004100400),
-	LL(0x0000082082101000), LL(0x0000010090104800), LL(0x0000011120104000), LL(0x0010111040080000),
-	LL(0x4040044400800000), LL(0x0000040404004102), LL(0x0000600204004080), LL(0x0000040806080200),
-	LL(0x0000802101104000), LL(0x0001042120080000), LL(0x0001042084100000), LL(0x0001104044000020),
-	LL(0x00080a0020004004), LL(0x0104041400400000), LL(0x0020050200810000), LL(0x0020040102002200)
+	LL(0x0002101002008020), LL(0x0021010101010000), LL(0x0008008902000200), LL(0x0004150600000000),
+	LL(0x0013104010000000), LL(0x000a011008000100), LL(0x0002021002082000), LL(0x0000402404200400),
+	LL(0x0000040404040402), LL(0x0000208202020020), LL(0x0050040400820000), LL(0x0000140400800003),
+	LL(0x00002110c0000002), LL(0x0000082404200200), LL(0x0000040202100c00), LL(0x0000030088040200),
+	LL(0x8008002008100080), LL(0x0004000208880100), LL(0x0010000101102100), LL(0x0028000082044000),
+	LL(0x0008800400a00400), LL(0x0040800048044000), LL(0x0009000404010400), LL(0x0000200084040240),
+	LL(0x0004200010021010), LL(0x0002500020040080), LL(0x0000241002080200), LL(0x0000480010820040),
+	LL(0x0020840000802010), LL(0x0010010000218800), LL(0x0008011002008200), LL(0x0000802002050400),
+	LL(0x0401082000082000), LL(0x0400900800040800), LL(0x0000402200100c00), LL(0x2000110800040040),
+	LL(0x0000610040040040), LL(0x0002004500021000), LL(0x0002040400010880), LL(0x0001820200004100),
+	LL(0x0022022004002000), LL(0x4001040202002000), LL(0x0000086090000800), LL(0x0100020214000200),
+	LL(0x3000080100400400), LL(0x0001411001000080), LL(0x0010020805000040), LL(0x00020a0202000020),
+	LL(0x0000808820110000), LL(0x0000220230040000), LL(0x0000020142080008), LL(0x8000080022880000),
+	LL(0x0100001002020208), LL(0x0000a00510008000), LL(0x0018100102040000), LL(0x0020081081004000),
+	LL(0x0000104110082000), LL(0x0000004104300200), LL(0x0000040104880400), LL(0x0100000040228800),
+	LL(0x4000108010020200), LL(0x0012000408100100), LL(0x0000442002020200), LL(0x0002040808010020)
 };
 
 static const U64 R_MASK[64] =
 {
-	LL(0x7e80808080808000), LL(0x3e40404040404000), LL(0x5e20202020202000), LL(0x6e10101010101000),
-	LL(0x7608080808080800), LL(0x7a04040404040400), LL(0x7c02020202020200), LL(0x7e01010101010100),
-	LL(0x007e808080808000), LL(0x003e404040404000), LL(0x005e202020202000), LL(0x006e101010101000),
-	LL(0x0076080808080800), LL(0x007a040404040400), LL(0x007c020202020200), LL(0x007e010101010100),
-	LL(0x00807e8080808000), LL(0x00403e4040404000), LL(0x00205e2020202000), LL(0x00106e1010101000),
-	LL(0x0008760808080800), LL(0x00047a0404040400), LL(0x00027c0202020200), LL(0x00017e0101010100),
-	LL(0x0080807e80808000), LL(0x0040403e40404000), LL(0x0020205e20202000), LL(0x0010106e10101000),
-	LL(0x0008087608080800), LL(0x0004047a04040400), LL(0x0002027c02020200), LL(0x0001017e01010100),
-	LL(0x008080807e808000), LL(0x004040403e404000), LL(0x002020205e202000), LL(0x001010106e101000),
-	LL(0x0008080876080800), LL(0x000404047a040400), LL(0x000202027c020200), LL(0x000101017e010100),
-	LL(0x00808080807e8000), LL(0x00404040403e4000), LL(0x00202020205e2000), LL(0x00101010106e1000),
-	LL(0x0008080808760800), LL(0x00040404047a0400), LL(0x00020202027c0200), LL(0x00010101017e0100),
-	LL(0x0080808080807e00), LL(0x0040404040403e00), LL(0x0020202020205e00), LL(0x0010101010106e00),
-	LL(0x0008080808087600), LL(0x0004040404047a00), LL(0x0002020202027c00), LL(0x0001010101017e00),
-	LL(0x008080808080807e), LL(0x004040404040403e), LL(0x002020202020205e), LL(0x001010101010106e),
-	LL(0x0008080808080876), LL(0x000404040404047a), LL(0x000202020202027c), LL(0x000101010101017e)
+	LL(0x000101010101017e), LL(0x000202020202027c), LL(0x000404040404047a), LL(0x0008080808080876),
+	LL(0x001010101010106e), LL(0x002020202020205e), LL(0x004040404040403e), LL(0x008080808080807e),
+	LL(0x0001010101017e00), LL(0x0002020202027c00), LL(0x0004040404047a00), LL(0x0008080808087600),
+	LL(0x0010101010106e00), LL(0x0020202020205e00), LL(0x0040404040403e00), LL(0x0080808080807e00),
+	LL(0x00010101017e0100), LL(0x00020202027c0200), LL(0x00040404047a0400), LL(0x0008080808760800),
+	LL(0x00101010106e1000), LL(0x00202020205e2000), LL(0x00404040403e4000), LL(0x00808080807e8000),
+	LL(0x000101017e010100), LL(0x000202027c020200), LL(0x000404047a040400), LL(0x0008080876080800),
+	LL(0x001010106e101000), LL(0x002020205e202000), LL(0x004040403e404000), LL(0x008080807e808000),
+	LL(0x0001017e01010100), LL(0x0002027c02020200), LL(0x0004047a04040400), LL(0x0008087608080800),
+	LL(0x0010106e10101000), LL(0x0020205e20202000), LL(0x0040403e40404000), LL(0x0080807e80808000),
+	LL(0x00017e0101010100), LL(0x00027c0202020200), LL(0x00047a0404040400), LL(0x0008760808080800),
+	LL(0x00106e1010101000), LL(0x00205e2020202000), LL(0x00403e4040404000), LL(0x00807e8080808000),
+	LL(0x007e010101010100), LL(0x007c020202020200), LL(0x007a040404040400), LL(0x0076080808080800),
+	LL(0x006e101010101000), LL(0x005e202020202000), LL(0x003e404040404000), LL(0x007e808080808000),
+	LL(0x7e01010101010100), LL(0x7c02020202020200), LL(0x7a04040404040400), LL(0x7608080808080800),
+	LL(0x6e10101010101000), LL(0x5e20202020202000), LL(0x3e40404040404000), LL(0x7e80808080808000)
 };
 
 static const int R_BITS[64] =
@@ -159,22 +159,22 @@ static const int R_SHIFT[64] =
 
 static const U64 R_MULT[64] =
 {
-	LL(0x8000040020408102), LL(0x0000100088030204), LL(0x0041000400020881), LL(0x0002000810210402),
-	LL(0x00010008a0100005), LL(0x0000081040208202), LL(0x0000208411004001), LL(0x0002008100104022),
-	LL(0x0000048500440200), LL(0x0081001200040300), LL(0x1000800200140180), LL(0x0010110500080100),
-	LL(0x1040880010008080), LL(0x1001110040200100), LL(0x0400200080400580), LL(0x0100800040016080),
-	LL(0x0000018420420001), LL(0x000001100884000a), LL(0x0024008006008004), LL(0x8048008004008008),
-	LL(0x020040100a020020), LL(0x021000240800a000), LL(0x8000a01000484000), LL(0x0004208040048010),
-	LL(0x0000010046000284), LL(0x0002009102000408), LL(0x0005004803000400), LL(0x0001800800805400),
-	LL(0x1024100080800800), LL(0x0030809000802000), LL(0x0840100800200060), LL(0x0500814000800020),
-	LL(0x0000010200208444), LL(0x0010010400081082), LL(0x8000120080440080), LL(0x2401001100080004),
-	LL(0x2000210100281000), LL(0x0003100080200084), LL(0x0014401080200080), LL(0x001080208000400c),
-	LL(0x0000120000428104), LL(0x0042040010080201), LL(0x0000808064004200), LL(0x0814010100080010),
-	LL(0x0002020008304020), LL(0x1080808020005000), LL(0x000040c000e01000), LL(0x088080800020c000),
-	LL(0x4200800080044100), LL(0x000300020011000c), LL(0x0042000200281004), LL(0x1280800800040080),
-	LL(0x4000805000080280), LL(0x4040802000805000), LL(0x0001004000208109), LL(0x0000801084400120),
-	LL(0x1080050000402080), LL(0x0c80220001000080), LL(0x0500280100040002), LL(0x0280120400800800),
-	LL(0x0080041000480082), LL(0x0100090040122000), LL(0x0040011000442004), LL(0x0280008040002110)
+	LL(0x0080006080104001), LL(0x0040004060085000), LL(0x0080100060018008), LL(0x0100050108201000),
+	LL(0x0200201004020108), LL(0x0100140001000812), LL(0x0200020001008c08), LL(0x00800820c0800100),
+	LL(0x8004800080c00020), LL(0x0060802002804000), LL(0x0820802000100088), LL(0x0208803000800800),
+	LL(0x0801001008000d00), LL(0x0090802200040080), LL(0x8101010200010004), LL(0x0001800080084300),
+	LL(0x2000818010204000), LL(0x0100424004201000), LL(0x0081010020001240), LL(0x0000420010200a02),
+	LL(0x0061010004080010), LL(0x04c0808002000400), LL(0x000004000a091008), LL(0x0000820008810044),
+	LL(0x0000c08200210200), LL(0x000450004000a008), LL(0x2200200080500080), LL(0x0040100080280084),
+	LL(0x0001000500080032), LL(0x0006001200041008), LL(0x2002000200240801), LL(0x0000802580004100),
+	LL(0x01004000808010a0), LL(0x2000446000401000), LL(0x0120200180801000), LL(0x4000480082801000),
+	LL(0x0041080101000410), LL(0x4000800c00801200), LL(0x8000081004000302), LL(0x0110800044800100),
+	LL(0x1040804000208002), LL(0x010040201000400a), LL(0x0080104082020020), LL(0x0188001000808008),
+	LL(0x5008002040040400), LL(0x00020008840a0010), LL(0x0020010810040022), LL(0x4000008100c20004),
+	LL(0x008002a040008080), LL(0x0101003040008100), LL(0x0000208442001200), LL(0x0100809000080180),
+	LL(0x0004001482080080), LL(0xa000800a00040080), LL(0x0000085002410400), LL(0x1100800141000080),
+	LL(0x0000224100800011), LL(0x0000400020890011), LL(0x0000400811002003), LL(0x0000100028210005),
+	LL(0x000200200c100802), LL(0x0022000408011002), LL(0x00010000c2000c01), LL(0x0001000021804201)
 };
 
 static int B_OFFSET[64];
@@ -335,13 +335,13 @@ void FindMaskR()
 	{
 		mask[f] = BB_ROOK_ATTACKS[f];
 		if (Col(f) != 0)
-			mask[f] &= LL(0x7f7f7f7f7f7f7f7f);
-		if (Col(f) != 7)
 			mask[f] &= LL(0xfefefefefefefefe);
+		if (Col(f) != 7)
+			mask[f] &= LL(0x7f7f7f7f7f7f7f7f);
 		if (Row(f) != 0)
-			mask[f] &= LL(0x00ffffffffffffff);
-		if (Row(f) != 7)
 			mask[f] &= LL(0xffffffffffffff00);
+		if (Row(f) != 7)
+			mask[f] &= LL(0x00ffffffffffffff);
 	}
 
 	PrintArray(mask);
@@ -490,11 +490,11 @@ void InitBitboards()
 	FLD f, from, to;
 	int delta;
 
-	x = LL(0x8000000000000000);
+	x = 1;
 	for (f = 0; f < 64; ++f)
 	{
 		BB_SINGLE[f] = x;
-		x >>= 1;
+		x <<= 1;
 	}
 
 	for (from = 0; from < 64; ++from)
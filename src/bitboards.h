@@ -75,19 +75,19 @@ inline FLD LSB(U64 b)
 
 #ifdef FAST_BITBOARDS
 	#ifdef __GNUC__
-		return 64 - __builtin_ffsll(b);
+		return __builtin_ctzll(b);
 	#endif
 	#ifdef _MSC_VER
 		#ifdef _WIN64
 			unsigned long i = 0;
 			if (_BitScanForward64(&i, b))
-				return (FLD)(63 - i);
+				return (FLD)i;
 		#else
 			unsigned long i = 0;
 			if (_BitScanForward(&i, (U32)b))
-				return (FLD)(63 - i);
+				return (FLD)i;
 			else if (_BitScanForward(&i, (U32)(b >> 32)))
-				return (FLD)(31 - i);
+				return (FLD)(32 + i);
 		#endif
 	#endif
 #endif
@@ -95,14 +95,14 @@ inline FLD LSB(U64 b)
 	static const U32 mult = 0x78291acf;
 	static const FLD table[64] =
 	{
-		 0, 33, 60, 31,  4, 49, 52, 30,
-		 3, 39, 13, 54,  8, 44, 42, 29,
-		 2, 34, 61, 10, 12, 40, 22, 45,
-		 7, 35, 62, 20, 17, 36, 63, 28,
-		 1, 32,  5, 59, 58, 14,  9, 57,
-		48, 11, 51, 23, 56, 21, 18, 47,
-		38,  6, 15, 50, 53, 24, 55, 19,
-		43, 16, 25, 41, 46, 26, 27, 37
+		63, 30,  3, 32, 59, 14, 11, 33,
+		60, 24, 50,  9, 55, 19, 21, 34,
+		61, 29,  2, 53, 51, 23, 41, 18,
+		56, 28,  1, 43, 46, 27,  0, 35,
+		62, 31, 58,  4,  5, 49, 54,  6,
+		15, 52, 12, 40,  7, 42, 45, 16,
+		25, 57, 48, 13, 10, 39,  8, 44,
+		20, 47, 38, 22, 17, 37, 36, 26
 	};
 
 	U64 x = b ^ (b - 1);
@@ -115,7 +115,7 @@ inline FLD LSB(U64 b)
 inline FLD PopLSB(U64& b)
 {
 	FLD f = LSB(b);
-	b ^= BB_SINGLE[f];
+	b &= b - 1;
 	return f;
 }
 ////////////////////////////////////////////////////////////////////////////////
@@ -143,24 +143,24 @@ U64  RookAttacksTrace(FLD f, U64 occ);
 U64  Shift(U64 b, int dir);
 void TestMagic();
 
-inline U64 Up(U64 b)    { return b << 8; }
-inline U64 Down(U64 b)  { return b >> 8; }
-inline U64 Left(U64 b)  { return (b & LL(0x7f7f7f7f7f7f7f7f)) << 1; }
-inline U64 Right(U64 b) { return (b & LL(0xfefefefefefefefe)) >> 1; }
+inline U64 Up(U64 b)    { return b >> 8; }
+inline U64 Down(U64 b)  { return b << 8; }
+inline U64 Left(U64 b)  { return (b & LL(0xfefefefefefefefe)) >> 1; }
+inline U64 Right(U64 b) { return (b & LL(0x7f7f7f7f7f7f7f7f)) << 1; }
 
-inline U64 UpLeft(U64 b)    { return (b & LL(0x007f7f7f7f7f7f7f)) << 9; }
-inline U64 UpRight(U64 b)   { return (b & LL(0x00fefefefefefefe)) << 7; }
-inline U64 DownLeft(U64 b)  { return (b & LL(0x7f7f7f7f7f7f7f00)) >> 7; }
-inline U64 DownRight(U64 b) { return (b & LL(0xfefefefefefefe00)) >> 9; }
+inline U64 UpLeft(U64 b)    { return (b & LL(0xfefefefefefefe00)) >> 9; }
+inline U64 UpRight(U64 b)   { return (b & LL(0x7f7f7f7f7f7f7f00)) >> 7; }
+inline U64 DownLeft(U64 b)  { return (b & LL(0x00fefefefefefefe)) << 7; }
+inline U64 DownRight(U64 b) { return (b & LL(0x007f7f7f7f7f7f7f)) << 9; }
 
-inline U64 Backward(U64 b, COLOR side) { return (side == WHITE)? (b >> 8) : (b << 8); }
-inline U64 DoubleBackward(U64 b, COLOR side) { return (side == WHITE)? (b >> 16) : (b << 16); }
+inline U64 Backward(U64 b, COLOR side) { return (side == WHITE)? (b << 8) : (b >> 8); }
+inline U64 DoubleBackward(U64 b, COLOR side) { return (side == WHITE)? (b << 16) : (b >> 16); }
 inline U64 BackwardLeft(U64 b, COLOR side) { return (side == WHITE)? DownLeft(b) : UpRight(b); }
 inline U64 BackwardRight(U64 b, COLOR side) { return (side == WHITE)? DownRight(b) : UpLeft(b); }
 
 const U64 BB_WHITE_FIELDS = LL(0xaa55aa55aa55aa55);
 const U64 BB_BLACK_FIELDS = LL(0x55aa55aa55aa55aa);
 
-const U64 BB_CENTER[2] = { LL(0x0000181818000000), LL(0x0000001818180000) };
+const U64 BB_CENTER[2] = { LL(0x0000001818180000), LL(0x0000181818000000) };
 
 #endif
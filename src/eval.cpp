@@ -10,9 +10,8 @@ extern string g_weightsFile;
 
 const EVAL LAZY_MARGIN = 200;
 
-const int PAWN_HASHTABLE_BITS = 16;
-const U64 PAWN_HASHTABLE_MASK = (U64(1) << PAWN_HASHTABLE_BITS) - 1;
-PawnStruct g_pawnHash[PAWN_HASHTABLE_MASK + 1];
+// for evaluations outside the search
+static PawnHashTable g_pawnHash;
 
 const size_t MAX_KNIGHT_MOBILITY = 8;
 const size_t MAX_KNIGHT_KING_DISTANCE = 9;
@@ -28,6 +27,7 @@ const size_t MAX_KING_EXPOSED = 27;
 const size_t MAX_PIECE_PAIRS = 15;
 
 Pair PSQ[14][64];
+IntPair PSQ_INT[14][64];
 Pair PSQ_PAWN_PASSED[2][64];
 Pair PSQ_PAWN_DOUBLED[2][64];
 Pair PSQ_PAWN_ISOLATED[2][64];
@@ -359,6 +359,12 @@ Pair EvalSide(const Position& pos, COLOR side, const PawnStruct& ps)
 ////////////////////////////////////////////////////////////////////////////////
 
 EVAL Evaluate(const Position& pos, EVAL alpha, EVAL beta)
+{
+	return Evaluate(pos, g_pawnHash, alpha, beta);
+}
+////////////////////////////////////////////////////////////////////////////////
+
+EVAL Evaluate(const Position& pos, PawnHashTable& pawnHash, EVAL alpha, EVAL beta)
 {
 	EVAL lazy = FastEval(pos);
 	if (lazy < alpha - LAZY_MARGIN)
@@ -369,10 +375,7 @@ EVAL Evaluate(const Position& pos, EVAL alpha, EVAL beta)
 	COLOR side = pos.Side();
 	COLOR opp = side ^ 1;
 
-	size_t index = pos.PawnHash() & PAWN_HASHTABLE_MASK;
-	PawnStruct& ps = g_pawnHash[index];
-	if (ps.pawnHash != pos.PawnHash())
-		ps.Read(pos);
+	const PawnStruct& ps = pawnHash.Get(pos);
 
 	Pair score = pos.Score(side) - pos.Score(opp);
 	score += EvalSide(pos, side, ps);
@@ -677,10 +680,7 @@ void GetFeatures(const Position& pos, vector<double>& features)
 	features.clear();
 	features.resize(NUMBER_OF_FEATURES);
 
-	size_t index = pos.PawnHash() & PAWN_HASHTABLE_MASK;
-	PawnStruct& ps = g_pawnHash[index];
-	if (ps.pawnHash != pos.PawnHash())
-		ps.Read(pos);
+	const PawnStruct& ps = g_pawnHash.Get(pos);
 
 	GetFeaturesSide(pos, features, WHITE, ps);
 	GetFeaturesSide(pos, features, BLACK, ps);
@@ -867,6 +867,16 @@ void InitPSQ(const vector<double>& x)
 
 #undef INIT_PSQ
 	}
+
+	// rounded copy for Position's incremental score
+	for (PIECE p = 0; p < 14; ++p)
+	{
+		for (FLD f = 0; f < 64; ++f)
+		{
+			PSQ_INT[p][f].mid = (I32)floor(PSQ[p][f].mid + 0.5);
+			PSQ_INT[p][f].end = (I32)floor(PSQ[p][f].end + 0.5);
+		}
+	}
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -912,6 +922,15 @@ int KingPawnStorm(const Position& pos, COLOR side, const PawnStruct& ps)
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+const PawnStruct& PawnHashTable::Get(const Position& pos)
+{
+	PawnStruct& ps = m_entries[pos.PawnHash() & PAWN_HASHTABLE_MASK];
+	if (ps.pawnHash != pos.PawnHash())
+		ps.Read(pos);
+	return ps;
+}
+////////////////////////////////////////////////////////////////////////////////
+
 void PawnStruct::Clear()
 {
 	pawnHash = 0;
@@ -8,12 +8,6 @@
 #include "eval_params.h"
 #include "position.h"
 
-void GetFeatures(const Position& pos, vector<double>& features);
-EVAL Evaluate(const Position& pos, EVAL alpha = -INFINITY_SCORE, EVAL beta = INFINITY_SCORE);
-EVAL FastEval(const Position& pos);
-void InitEval();
-void InitEval(const vector<double>& x);
-
 struct PawnStruct
 {
 	PawnStruct()
@@ -35,4 +29,29 @@ struct PawnStruct
 	U64 safe[2];
 };
 
+const int PAWN_HASHTABLE_BITS = 14;
+const U64 PAWN_HASHTABLE_MASK = (U64(1) << PAWN_HASHTABLE_BITS) - 1;
+
+//
+//   Pawn structures by pawn key. Every search thread owns a table, so
+//   no thread reads an entry while another one rewrites it
+//
+
+class PawnHashTable
+{
+public:
+	PawnHashTable() : m_entries(PAWN_HASHTABLE_MASK + 1) {}
+	const PawnStruct& Get(const Position& pos);
+
+private:
+	vector<PawnStruct> m_entries;
+};
+
+void GetFeatures(const Position& pos, vector<double>& features);
+EVAL Evaluate(const Position& pos, EVAL alpha = -INFINITY_SCORE, EVAL beta = INFINITY_SCORE);
+EVAL Evaluate(const Position& pos, PawnHashTable& pawnHash, EVAL alpha = -INFINITY_SCORE, EVAL beta = INFINITY_SCORE);
+EVAL FastEval(const Position& pos);
+void InitEval();
+void InitEval(const vector<double>& x);
+
 #endif
@@ -4,6 +4,7 @@
 
 #include "eval.h"
 #include "learn.h"
+#include "mate.h"
 #include "moves.h"
 #include "notation.h"
 #include "search.h"
@@ -19,17 +20,41 @@ const int MIN_HASH_SIZE = 1;
 const int MAX_HASH_SIZE = 4096;
 const int DEFAULT_HASH_SIZE = 128;
 
+const int DEFAULT_MOVES_TO_GO = 30;
+const int MAX_MOVES_TO_GO = 50;
+const int TIME_RESERVE = 30;   // ms kept back for lag and GUI overhead
+
+const int DEFAULT_BENCH_DEPTH = 12;
+const int DEFAULT_REPRO_NODES = 200000;
+
+static const char* const BENCH_FENS[] =
+{
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+	"r1bq1rk1/pp2bppp/2n2n2/2pp4/3P4/2PBPN2/PP1N1PPP/R2QK2R w KQ - 0 9",
+	"8/8/4k3/8/2K5/8/3P4/8 w - - 0 1",
+	"2r3k1/pp3ppp/2n1b3/3pP3/3P4/P1N2N2/1P3PPP/2R3K1 b - - 0 20",
+	"r1b2rk1/2q1b1pp/p2ppn2/1p6/3QP3/1BN1B3/PPP3PP/R4RK1 w - - 0 1",
+	"2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - - 0 1",
+	"r4q1k/p2bR1rp/2p2Q1N/5p2/5p2/2P5/PP3PPP/R5K1 w - - 0 1",
+	"4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19"
+};
+
 Position g_pos;
 deque<string> g_queue;
 FILE* g_log = NULL;
+FILE* g_telemetry = NULL;
 
 bool g_console = false;
 bool g_xboard = false;
 bool g_uci = true;
+bool g_debug = false;
 
 static string g_s;
 static vector<string> g_tokens;
 static bool g_force = false;
+static bool g_analyze = false;   // xboard analysis mode, left by exit
 
 static int g_increment = 0;
 static int g_restTime = 0;
@@ -39,16 +64,51 @@ static int g_movesPerSession = 0;
 void OnZero();
 void ParseSelfplayLimits(const char* s, int& gamesLimit, int& timeLimitInSeconds);
 
+void SetTimeLimits(int restTime, int increment, int movesToGo, bool adaptive)
+{
+	//
+	//   Adaptive: plan restTime / movesToGo plus most of the increment,
+	//   the search stretches or shrinks it within maxTimeHard.
+	//   Fixed: the old rest / 40 and rest / 2 split, kept as the
+	//   baseline for A/B matches
+	//
+
+	Search::s_params.adaptiveTime = adaptive;
+
+	if (!adaptive)
+	{
+		Search::s_params.maxTimeSoft = restTime / 40;
+		Search::s_params.maxTimeHard = restTime / 2;
+		return;
+	}
+
+	if (movesToGo <= 0)
+		movesToGo = DEFAULT_MOVES_TO_GO;
+	movesToGo = std::min(movesToGo, MAX_MOVES_TO_GO);
+
+	int rest = std::max(restTime - TIME_RESERVE, 1);
+	int soft = std::min(rest / movesToGo + 3 * increment / 4, rest);
+	int hard = std::min(5 * soft, std::max(rest / 2, soft));
+
+	Search::s_params.maxTimeSoft = soft;
+	Search::s_params.maxTimeHard = hard;
+}
+////////////////////////////////////////////////////////////////////////////////
+
 void CalculateTimeLimits()
 {
+	Search::s_params.adaptiveTime = false;
 	if (g_restTime == 0)
 		return;
 
-	Search::s_params.maxTimeSoft = g_restTime / 40;
-	Search::s_params.maxTimeHard = g_restTime / 2;
+	int movesToGo = g_restMoves;
+	if (movesToGo == 0 && g_movesPerSession > 0)
+		movesToGo = g_movesPerSession - (g_pos.Ply() / 2) % g_movesPerSession;
+
+	SetTimeLimits(g_restTime, g_increment, movesToGo, true);
 
 	Log("TIME: rest = %d, moves = %d, inc = %d ==> stHard = %d, stSoft = %d",
-		g_restTime, g_restMoves, g_increment, Search::s_params.maxTimeHard, Search::s_params.maxTimeSoft);
+		g_restTime, movesToGo, g_increment, Search::s_params.maxTimeHard, Search::s_params.maxTimeSoft);
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -65,7 +125,83 @@ void OnAnalyze()
 	Search::s_params.maxTimeSoft = 0;
 	Search::s_params.silent = false;
 
+	g_analyze = true;
 	Search::StartSearch(pos);
+
+#ifdef SINGLE_THREAD
+	// moves and exit were read by the search itself, which queues the next analysis
+	g_analyze = false;
+#endif
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void OnBench()
+{
+	//
+	//   bench [<depth>]
+	//
+	//   Fixed-depth search of a built-in position set, each from empty
+	//   tables. The node total is a signature of the search: it changes
+	//   only when the tree does
+	//
+
+	int depth = (g_tokens.size() > 1)? atoi(g_tokens[1].c_str()) : DEFAULT_BENCH_DEPTH;
+	if (depth <= 0)
+		return;
+
+	// tunable parameters are kept, only the limits change
+	SearchParams savedParams = Search::s_params;
+	Search::s_params.analysis = false;
+	Search::s_params.silent = true;
+	Search::s_params.adaptiveTime = false;
+	Search::s_params.limitDepth = true;
+	Search::s_params.limitNodes = false;
+	Search::s_params.limitTime = false;
+	Search::s_params.limitKnps = false;
+	Search::s_params.maxDepth = depth;
+	Search::s_params.multipv = 1;
+
+	NODES total = 0;
+	U64 t0 = GetProcTime();
+
+	const int numFens = sizeof(BENCH_FENS) / sizeof(BENCH_FENS[0]);
+	for (int i = 0; i < numFens; ++i)
+	{
+		Position pos;
+		if (!pos.SetFEN(BENCH_FENS[i]))
+			continue;
+
+		Search::ClearHash();
+		Search::ClearHistory();
+		Search::StartSearch(pos);
+
+		NODES nodes = Search::TotalNodes();
+		total += nodes;
+		Out(" %2d %12llu  %s\n", i + 1, (unsigned long long)nodes, BENCH_FENS[i]);
+	}
+
+	U64 t1 = GetProcTime();
+	double dt = static_cast<double>((t1 - t0) / 1000.);
+
+	cout << endl;
+	cout << " Nodes: " << total << endl;
+	cout << " Time:  " << dt << endl;
+	if (dt > 0) cout << " Knps:  " << total / dt / 1000. << endl;
+	cout << endl;
+
+	Search::s_params = savedParams;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void OnDebug()
+{
+	if (g_tokens.size() > 1)
+		g_debug = (g_tokens[1] == "on");
+	else
+		g_debug = !g_debug;
+
+	if (!g_uci)
+		Out("debug %s\n", g_debug? "on" : "off");
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -121,12 +257,18 @@ void OnFlip()
 void OnGoUci()
 {
 	Search::s_params.analysis = false;
+	Search::s_params.limitDepth = false;
+	Search::s_params.limitNodes = false;
+	Search::s_params.limitTime = false;
 	Search::s_params.maxDepth = 0;
 	Search::s_params.maxNodes = 0;
 	Search::s_params.maxTimeHard = 0;
 	Search::s_params.maxTimeSoft = 0;
 	Search::s_params.silent = false;
 	g_restTime = 0;
+	g_restMoves = 0;
+	g_increment = 0;
+	int mateMoves = 0;
 
 	for (size_t i = 1; i < g_tokens.size(); ++i)
 	{
@@ -175,12 +317,41 @@ void OnGoUci()
 				Search::s_params.maxNodes = atoi(g_tokens[i + 1].c_str());
 				++i;
 			}
+			else if (token == "mate")
+			{
+				mateMoves = atoi(g_tokens[i + 1].c_str());
+				++i;
+			}
 		}
 	}
 
 	CalculateTimeLimits();
+
+	if (mateMoves > 0)
+	{
+		MateParams params;
+		params.maxMoves = mateMoves;
+		if (!Search::s_params.analysis)
+		{
+			if (Search::s_params.limitNodes)
+				params.maxNodes = Search::s_params.maxNodes;
+			if (Search::s_params.limitTime)
+				params.maxTime = Search::s_params.maxTimeHard;
+		}
+
+		MateResult result;
+		StartMateSearch(g_pos, params, result);
+
+		if (!result.bestMove.IsNull())
+			Out("bestmove %s\n", MoveToStrLong(result.bestMove).c_str());
+		return;
+	}
+
 	Search::StartSearch(g_pos);
 
+	if (g_debug && Search::s_results.stopTime != 0)
+		Out("info string stop latency %d ms\n", (int)(GetMonotonicTime() - Search::s_results.stopTime));
+
 	Move bestMove = Search::s_results.bestMove;
 	if (!bestMove.IsNull())
 		Out("bestmove %s\n", MoveToStrLong(bestMove).c_str());
@@ -370,6 +541,190 @@ void OnLoad()
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+static double EloDifference(double score)
+{
+	score = std::max(0.001, std::min(0.999, score));
+	return -400 * log10(1 / score - 1);
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void OnMatch()
+{
+	//
+	//   match <games> <seconds> [<increment>]
+	//   match <games> nodes <nodes>
+	//
+	//   A/B test at equal clock time: the adaptive time manager (A)
+	//   plays the fixed rest / 40 allocation (B). With a node limit both
+	//   sides search that many nodes per move, A with the current option
+	//   values and B with the defaults. Every random opening is played
+	//   twice, with colours reversed
+	//
+
+	if (g_tokens.size() < 3)
+		return;
+
+	int games = atoi(g_tokens[1].c_str());
+	bool fixedNodes = (g_tokens[2] == "nodes");
+	int nodes = 0;
+	int baseTime = 0;
+	int increment = 0;
+
+	if (fixedNodes)
+	{
+		if (g_tokens.size() < 4)
+			return;
+		nodes = atoi(g_tokens[3].c_str());
+		if (games <= 0 || nodes <= 0)
+			return;
+	}
+	else
+	{
+		baseTime = static_cast<int>(1000 * atof(g_tokens[2].c_str()));
+		increment = (g_tokens.size() > 3)? static_cast<int>(1000 * atof(g_tokens[3].c_str())) : 0;
+		if (games <= 0 || baseTime <= 0)
+			return;
+	}
+
+	SearchParams savedParams = Search::s_params;
+	Search::s_params = SearchParams();
+	Search::s_params.silent = true;
+
+	SearchParams paramsA = savedParams;
+	SearchParams paramsB = SearchParams();
+	if (fixedNodes)
+	{
+		SearchParams* params[2] = { &paramsA, &paramsB };
+		for (int i = 0; i < 2; ++i)
+		{
+			params[i]->analysis = false;
+			params[i]->silent = true;
+			params[i]->limitDepth = false;
+			params[i]->limitTime = false;
+			params[i]->limitKnps = false;
+			params[i]->limitNodes = true;
+			params[i]->maxNodes = nodes;
+		}
+	}
+
+	RandSeed(time(0));
+	vector<Move> opening;
+	int wins = 0, draws = 0, losses = 0;
+
+	for (int game = 0; game < games; ++game)
+	{
+		Position pos;
+		pos.SetInitial();
+
+		if (game % 2 == 0)
+		{
+			opening.clear();
+			for (int ply = 0; ply < 6; ++ply)
+			{
+				Move mv = Search::GetRandomMove(pos);
+				if (mv.IsNull())
+					break;
+				opening.push_back(mv);
+				pos.MakeMove(mv);
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < opening.size(); ++i)
+				pos.MakeMove(opening[i]);
+		}
+
+		Search::ClearHash();
+		Search::ClearHistory();
+
+		COLOR sideA = (game % 2 == 0)? WHITE : BLACK;
+		int clock[2] = { baseTime, baseTime };
+		string result, comment;
+
+		while (!Search::IsGameOver(pos, result, comment))
+		{
+			COLOR side = pos.Side();
+			if (fixedNodes)
+				Search::s_params = (side == sideA)? paramsA : paramsB;
+			else
+				SetTimeLimits(clock[side], increment, 0, side == sideA);
+
+			U64 t0 = GetMonotonicTime();
+			Search::StartSearch(pos);
+			if (!fixedNodes)
+				clock[side] -= static_cast<int>(GetMonotonicTime() - t0);
+
+			Move mv = Search::s_results.bestMove;
+			if (mv.IsNull() || clock[side] < 0)
+			{
+				result = (side == WHITE)? "0-1" : "1-0";
+				comment = "{Time forfeit}";
+				break;
+			}
+			if (!fixedNodes)
+				clock[side] += increment;
+
+			pos.MakeMove(mv);
+
+			if (pos.Ply() > 600)
+			{
+				result = "1/2-1/2";
+				comment = "{Adjudication: too long}";
+				break;
+			}
+		}
+
+		if (result == "1/2-1/2")
+			++draws;
+		else if ((result == "1-0") == (sideA == WHITE))
+			++wins;
+		else
+			++losses;
+
+		Out("Game %d, A as %s: %s %s",
+			game + 1,
+			(sideA == WHITE)? "white" : "black",
+			result.c_str(),
+			comment.c_str());
+		Out("   +%d =%d -%d\n", wins, draws, losses);
+	}
+
+	int n = wins + draws + losses;
+	double score = (wins + 0.5 * draws) / n;
+	double variance = (wins * (1 - score) * (1 - score) +
+		draws * (0.5 - score) * (0.5 - score) +
+		losses * score * score) / n;
+	double margin = 1.96 * sqrt(variance / n);
+
+	Out("\nScore of A vs B: +%d =%d -%d (%.1f%%)\n", wins, draws, losses, 100 * score);
+	Out("Elo difference: %.1f +/- %.1f\n\n",
+		EloDifference(score),
+		(EloDifference(score + margin) - EloDifference(score - margin)) / 2);
+
+	Search::s_params = savedParams;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void OnMate()
+{
+	//
+	//   mate <moves>
+	//   Looks for the shortest forced mate up to the given length,
+	//   runs until solved or interrupted
+	//
+
+	if (g_tokens.size() < 2)
+		return;
+
+	MateParams params;
+	params.maxMoves = atoi(g_tokens[1].c_str());
+
+	MateResult result;
+	StartMateSearch(g_pos, params, result);
+	Out("\n");
+}
+////////////////////////////////////////////////////////////////////////////////
+
 void OnMT()
 {
 	if (g_tokens.size() < 2)
@@ -411,6 +766,7 @@ void OnNew()
 	g_pos.SetInitial();
 
 	Search::ClearHash();
+	Search::ClearHistory();
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -509,6 +865,78 @@ void OnProtover()
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+void OnRepro()
+{
+	//
+	//   repro [<nodes>]
+	//
+	//   Searches every bench position twice with the same node limit,
+	//   each time from empty tables, and compares best move, score and
+	//   nodes. With Threads > 1 and DeterministicSMP on, any difference
+	//   means the result depends on thread scheduling
+	//
+
+	int maxNodes = (g_tokens.size() > 1)? atoi(g_tokens[1].c_str()) : DEFAULT_REPRO_NODES;
+	if (maxNodes <= 0)
+		return;
+
+	if (Search::NumThreads() < 2 || !Search::s_params.deterministic)
+		Out("warning: only meaningful with Threads > 1 and DeterministicSMP on\n");
+
+	SearchParams savedParams = Search::s_params;
+	Search::s_params.analysis = false;
+	Search::s_params.silent = true;
+	Search::s_params.adaptiveTime = false;
+	Search::s_params.limitDepth = false;
+	Search::s_params.limitNodes = true;
+	Search::s_params.limitTime = false;
+	Search::s_params.limitKnps = false;
+	Search::s_params.maxNodes = maxNodes;
+	Search::s_params.multipv = 1;
+
+	int failed = 0;
+
+	const int numFens = sizeof(BENCH_FENS) / sizeof(BENCH_FENS[0]);
+	for (int i = 0; i < numFens; ++i)
+	{
+		Position pos;
+		if (!pos.SetFEN(BENCH_FENS[i]))
+			continue;
+
+		Move bestMove[2];
+		EVAL score[2];
+		NODES nodes[2];
+
+		for (int run = 0; run < 2; ++run)
+		{
+			Search::ClearHash();
+			Search::ClearHistory();
+			Search::StartSearch(pos);
+
+			bestMove[run] = Search::s_results.bestMove;
+			score[run] = Search::s_results.score;
+			nodes[run] = Search::TotalNodes();
+		}
+
+		bool same = (bestMove[0] == bestMove[1] && score[0] == score[1] && nodes[0] == nodes[1]);
+		if (!same)
+			++failed;
+
+		Out(" %2d  %-5s %6d %10llu", i + 1,
+			MoveToStrLong(bestMove[0]).c_str(), score[0], (unsigned long long)nodes[0]);
+		if (same)
+			Out("  ok\n");
+		else
+			Out("  DIFFERS: %-5s %6d %10llu\n",
+				MoveToStrLong(bestMove[1]).c_str(), score[1], (unsigned long long)nodes[1]);
+	}
+
+	Out("\n %s: %d of %d positions differ\n\n", failed? "FAILED" : "PASSED", failed, numFens);
+
+	Search::s_params = savedParams;
+}
+////////////////////////////////////////////////////////////////////////////////
+
 void OnSample()
 {
 	if (g_tokens.size() < 4)
@@ -759,6 +1187,31 @@ void OnSetboard()
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+void SetTelemetry(const string& target)
+{
+	//
+	//   Per-iteration JSON lines go to stderr, are appended to a file,
+	//   or are switched off by <empty>
+	//
+
+	if (g_telemetry != NULL && g_telemetry != stderr)
+		fclose(g_telemetry);
+	g_telemetry = NULL;
+
+	if (target.empty() || target == "<empty>")
+		return;
+
+	if (target == "stderr")
+		g_telemetry = stderr;
+	else
+	{
+		g_telemetry = fopen(target.c_str(), "at");
+		if (g_telemetry == NULL)
+			Out("Can't open file: %s\n", target.c_str());
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+
 void OnSetoption()
 {
 	if (g_tokens.size() < 5)
@@ -774,9 +1227,25 @@ void OnSetoption()
 #ifndef SINGLE_THREAD
 	else if (name == "Threads")
 		Search::InitThreads(atoi(value.c_str()));
+	else if (name == "ThreadAffinity")
+		Search::SetThreadAffinity(value == "true");
+	else if (name == "DeterministicSMP")
+		Search::s_params.deterministic = (value == "true");
 #endif
+	else if (name == "HashInterleave")
+		Search::SetHashInterleave(value == "true");
+	else if (name == "MateHash")
+		SetMateHashSize(atoi(value.c_str()));
 	else if (name == "MultiPV")
-		Search::s_params.multipv = atoi(value.c_str());
+		Search::s_params.multipv = std::min(std::max(1, atoi(value.c_str())), MAX_MULTIPV);
+	else if (name == "AspirationDelta")
+		Search::s_params.aspirationDelta = std::max(1, atoi(value.c_str()));
+	else if (name == "AspirationGrowth")
+		Search::s_params.aspirationGrowth = std::max(101, atoi(value.c_str()));
+	else if (name == "RazorMargin")
+		Search::s_params.razorMargin = std::max(0, atoi(value.c_str()));
+	else if (name == "ProbCutMargin")
+		Search::s_params.probCutMargin = std::max(0, atoi(value.c_str()));
 	else if (name == "Strength")
 		Search::SetStrength(atoi(value.c_str()));
 	else if (name == "Log" && value == "true")
@@ -784,6 +1253,8 @@ void OnSetoption()
 		if (g_log == NULL)
 			g_log = fopen("GreKo.log", "at");
 	}
+	else if (name == "Telemetry")
+		SetTelemetry(value);
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -920,15 +1391,36 @@ void OnUCI()
 #ifndef SINGLE_THREAD
 	Out("option name Threads type spin default 1 min 1 max %d\n",
 		MAX_NUM_THREADS);
+	Out("option name ThreadAffinity type check default true\n");
+	Out("option name DeterministicSMP type check default true\n");
 #endif
 
-	Out("option name MultiPV type spin default 1 min 1 max 16\n");
+	Out("option name HashInterleave type check default false\n");
+	Out("option name MateHash type spin default %d min %d max %d\n",
+		DEFAULT_MATE_HASH_SIZE,
+		MIN_HASH_SIZE,
+		MAX_HASH_SIZE);
+
+	Out("option name MultiPV type spin default 1 min 1 max %d\n", MAX_MULTIPV);
+	Out("option name AspirationDelta type spin default %d min 1 max 500\n", DEFAULT_ASPIRATION_DELTA);
+	Out("option name AspirationGrowth type spin default %d min 101 max 1000\n", DEFAULT_ASPIRATION_GROWTH);
+	Out("option name RazorMargin type spin default %d min 0 max 1000\n", DEFAULT_RAZOR_MARGIN);
+	Out("option name ProbCutMargin type spin default %d min 0 max 1000\n", DEFAULT_PROBCUT_MARGIN);
 	Out("option name Strength type spin default 100 min 0 max 100\n");
 	Out("option name Log type check default false\n");
+	Out("option name Telemetry type string default <empty>\n");
 	Out("uciok\n");
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+void OnUndo()
+{
+	g_pos.UnmakeMove();
+	if (g_analyze)
+		OnAnalyze();
+}
+////////////////////////////////////////////////////////////////////////////////
+
 void OnXboard()
 {
 	g_console = false;
@@ -982,6 +1474,71 @@ void OnQuit()
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+int FilterInput(const string& s)
+{
+	//
+	//   Called by the input thread for every line, while the command loop
+	//   may be busy in a search. Only looks at the lines: the position and
+	//   the search belong to the command loop. Lines that stop a search
+	//   interrupt even when none runs yet, the search started by an
+	//   earlier line then stops at once
+	//
+
+	static bool analyzing = false;   // seen analyze, not yet exit
+
+	vector<string> tokens;
+	Split(s, tokens);
+	if (tokens.empty())
+		return INPUT_QUEUE;
+
+	const string& cmd = tokens[0];
+
+	if (Is(cmd, "isready", 1))
+	{
+		if (!Searching())
+			return INPUT_QUEUE;
+		Out("readyok\n");
+		return INPUT_DONE;
+	}
+
+	if (Is(cmd, "analyze", 1))
+	{
+		analyzing = true;
+		return INPUT_QUEUE;
+	}
+
+	if (Is(cmd, "exit", 2))
+	{
+		analyzing = false;
+		return INPUT_INTERRUPT;
+	}
+
+	if (Is(cmd, "ponderhit", 5) ||
+		Is(cmd, "quit", 1) ||
+		Is(cmd, "stop", 3))
+	{
+		return INPUT_INTERRUPT;
+	}
+
+	if (analyzing)
+	{
+		// the loop makes the move and analyzes again
+		if (Is(cmd, "undo", 1) || CanBeMove(cmd))
+			return INPUT_INTERRUPT;
+	}
+	else if (cmd == "?" || Is(cmd, "result", 3))
+		return INPUT_INTERRUPT;
+
+	return INPUT_QUEUE;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void InterruptSearch()
+{
+	Search::RequestStop();
+}
+////////////////////////////////////////////////////////////////////////////////
+
 void RunCommandLine()
 {
 	while (1)
@@ -1000,7 +1557,8 @@ void RunCommandLine()
 				else
 					cout << "Black(" << g_pos.Ply() / 2 + 1 << "): ";
 			}
-			getline(cin, g_s);
+			if (!WaitInput(g_s))
+				OnQuit();
 		}
 
 		if (g_s.empty())
@@ -1023,8 +1581,11 @@ void RunCommandLine()
 
 		ON_CMD(analyze,    1, OnAnalyze())
 		ON_CMD(board,      1, g_pos.Print())
+		ON_CMD(bench,      2, OnBench())
+		ON_CMD(debug,      3, OnDebug())
 		ON_CMD(dump,       2, OnDump())
 		ON_CMD(eval,       2, OnEval())
+		ON_CMD(exit,       2, g_analyze = false)
 		ON_CMD(fen,        2, OnFEN())
 		ON_CMD(flip,       2, OnFlip())
 		ON_CMD(force,      2, g_force = true)
@@ -1034,15 +1595,20 @@ void RunCommandLine()
 		ON_CMD(level,      3, OnLevel())
 		ON_CMD(list,       2, OnList())
 		ON_CMD(load,       2, OnLoad())
+		ON_CMD(match,      3, OnMatch())
+		ON_CMD(mate,       4, OnMate())
 		ON_CMD(mt,         2, OnMT())
 		ON_CMD(new,        1, OnNew())
 		ON_CMD(perft,      2, OnPerft())
 		ON_CMD(pgntofen,   2, OnPgnToFen())
 		ON_CMD(ping,       2, OnPing())
+		ON_CMD(ponderhit,  5, (void)0)
 		ON_CMD(position,   2, OnPosition())
 		ON_CMD(predict,    3, OnPredict())
 		ON_CMD(protover,   3, OnProtover())
 		ON_CMD(quit,       1, OnQuit())
+		ON_CMD(repro,      3, OnRepro())
+		ON_CMD(result,     3, (void)0)
 		ON_CMD(sample,     2, OnSample())
 		ON_CMD(sd,         2, OnSD())
 		ON_CMD(see,        2, OnSEE())
@@ -1052,19 +1618,32 @@ void RunCommandLine()
 		ON_CMD(setoption,  3, OnSetoption())
 		ON_CMD(sn,         2, OnSN())
 		ON_CMD(st,         2, OnST())
+		ON_CMD(stats,      3, Search::PrintStats())
+		ON_CMD(stop,       3, (void)0)
 		ON_CMD(test,       2, OnTest())
 		ON_CMD(time,       2, OnTime())
 		ON_CMD(training,   2, OnTraining())
 		ON_CMD(uci,        1, OnUCI())
 		ON_CMD(ucinewgame, 4, OnNew())
-		ON_CMD(undo,       1, g_pos.UnmakeMove())
+		ON_CMD(undo,       1, OnUndo())
 		ON_CMD(xboard,     1, OnXboard())
 		ON_CMD(zero,       1, OnZero())
 #undef ON_CMD
 
+		// stopped the search, nothing more to do
+		if (cmd == "?")
+			continue;
+
 		if (CanBeMove(cmd))
 		{
 			Move mv = StrToMove(cmd, g_pos);
+			if (g_analyze)
+			{
+				if (!mv.IsNull())
+					g_pos.MakeMove(mv);
+				OnAnalyze();
+				continue;
+			}
 			if (!mv.IsNull())
 			{
 				g_pos.MakeMove(mv);
@@ -1086,6 +1665,7 @@ void RunCommandLine()
 int main(int argc, const char* argv[])
 {
 	InitIO();
+	StartInputThread(FilterInput, InterruptSearch);
 
 	InitBitboards();
 	Position::InitHashNumbers();
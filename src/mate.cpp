@@ -0,0 +1,565 @@
+//   GreKo chess engine
+//   (c) 2002-2021 Vladimir Medvedev <vrm@bk.ru>
+//   http://greko.su
+
+#include "mate.h"
+#include "moves.h"
+#include "notation.h"
+#include "search.h"
+#include "utils.h"
+
+extern bool g_uci;
+
+//
+//   Depth-first proof-number search (df-pn) for forced mates.
+//
+//   The side to move at the root is the attacker. Its nodes are OR nodes,
+//   proven by a single mating move; the defender's nodes are AND nodes,
+//   proven only when every reply is. Proof and disproof numbers estimate
+//   how many leaves remain to be solved, and the search always descends
+//   into the most-proving child until a threshold is exceeded.
+//
+//   A node is keyed by the position and the number of plies left, so the
+//   entries of a mate-in-N iteration are reused by all the longer ones
+//
+
+typedef U32 PN;
+
+const PN    PN_INFINITY = 100000000;
+const NODES MATE_CHECK_INTERVAL = 4096;
+const U64   MATE_DEPTH_KEY = 0x9e3779b97f4a7c15ULL;
+
+struct MateEntry
+{
+	U64 m_key;
+	PN  m_pn;
+	PN  m_dn;
+	U32 m_work;   // nodes spent below the entry, decides replacement
+	U32 m_mv;     // mating move, or the most promising one
+	U32 m_age;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+struct MateChild
+{
+	Move m_mv;
+	U64  m_key;
+	PN   m_pn;
+	PN   m_dn;
+	U32  m_work;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+static vector<MateEntry> g_mateHash;
+static size_t            g_mateHashSize = 0;
+static double            g_mateHashMb = DEFAULT_MATE_HASH_SIZE;
+static U32               g_mateAge = 0;
+
+static Position          g_matePos;
+static MateParams        g_mateParams;
+static NODES             g_mateNodes = 0;
+static NODES             g_nextMateCheck = 0;
+static U64               g_mateStartTime = 0;
+static bool              g_mateStop = false;
+
+static vector<MateChild> g_mateChildren[2 * MAX_MATE_MOVES];
+static MoveList          g_mateMoves[2 * MAX_MATE_MOVES + 1];
+
+static PN AddPN(PN a, PN b)
+{
+	return std::min(a + b, PN_INFINITY);
+}
+////////////////////////////////////////////////////////////////////////////////
+
+static void CheckMateLimits()
+{
+	if (g_mateParams.maxNodes > 0 && g_mateNodes >= g_mateParams.maxNodes)
+		g_mateStop = true;
+
+	if (g_mateStop || g_mateNodes < g_nextMateCheck)
+		return;
+
+	g_nextMateCheck = g_mateNodes + MATE_CHECK_INTERVAL;
+
+	if (g_mateParams.maxTime > 0 && GetMonotonicTime() - g_mateStartTime >= g_mateParams.maxTime)
+		g_mateStop = true;
+
+#ifndef SINGLE_THREAD
+	// the input thread marks the lines that stop a search
+	if (InputInterrupted())
+		g_mateStop = true;
+#else
+	string s;
+	while (!g_mateStop && PollInput(s))
+	{
+		Log("> %s\n", s.c_str());
+
+		vector<string> tokens;
+		Split(s, tokens);
+		if (tokens.empty())
+			continue;
+
+		string cmd = tokens[0];
+		if (cmd == "?" || Is(cmd, "exit", 1) || Is(cmd, "stop", 1))
+			g_mateStop = true;
+		else if (Is(cmd, "isready", 1))
+			Out("readyok\n");
+		else if (Is(cmd, "quit", 1))
+		{
+			Search::QuitThreads();
+			exit(0);
+		}
+	}
+#endif
+}
+////////////////////////////////////////////////////////////////////////////////
+
+static bool HasLegalMove(Position& pos, MoveList& mvlist)
+{
+	GenAllMoves(pos, mvlist);
+	for (size_t i = 0; i < mvlist.Size(); ++i)
+	{
+		if (pos.MakeMove(mvlist[i].m_mv))
+		{
+			pos.UnmakeMove();
+			return true;
+		}
+	}
+	return false;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+static U64 MateKey(const Position& pos, int remaining)
+{
+	return pos.Hash() ^ (MATE_DEPTH_KEY * static_cast<U64>(remaining));
+}
+////////////////////////////////////////////////////////////////////////////////
+
+static const MateEntry* ProbeMate(U64 key)
+{
+	//
+	//   Two entries per bucket: the one with less work is replaced,
+	//   so the latest result is always found right after it is stored
+	//
+
+	size_t index = static_cast<size_t>(key & (g_mateHashSize - 1)) & ~size_t(1);
+	for (size_t i = index; i < index + 2; ++i)
+	{
+		if (g_mateHash[i].m_key == key && g_mateHash[i].m_age != 0)
+			return &g_mateHash[i];
+	}
+	return NULL;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+static void RecordMate(U64 key, PN pn, PN dn, U32 work, Move mv)
+{
+	size_t index = static_cast<size_t>(key & (g_mateHashSize - 1)) & ~size_t(1);
+	MateEntry* pEntry = &g_mateHash[index];
+
+	for (size_t i = index; i < index + 2; ++i)
+	{
+		MateEntry& entry = g_mateHash[i];
+		if (entry.m_key == key || entry.m_age != g_mateAge)
+		{
+			pEntry = &entry;
+			break;
+		}
+		if (entry.m_work < pEntry->m_work)
+			pEntry = &entry;
+	}
+
+	pEntry->m_key = key;
+	pEntry->m_pn = pn;
+	pEntry->m_dn = dn;
+	pEntry->m_work = work;
+	pEntry->m_mv = mv.ToInt();
+	pEntry->m_age = g_mateAge;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+static void MateMID(MateChild& node, int ply, int remaining, PN thPn, PN thDn)
+{
+	Position& pos = g_matePos;
+	bool orNode = (remaining % 2 == 1);
+	NODES startNodes = g_mateNodes;
+
+	CheckMateLimits();
+
+	//
+	//   Expanding: children are kept here as well as in the hash table,
+	//   so a result pushed out of the table still counts for this node
+	//
+
+	vector<MateChild>& children = g_mateChildren[ply];
+	children.clear();
+
+	MoveList& mvlist = g_mateMoves[ply];
+	GenAllMoves(pos, mvlist);
+
+	for (size_t i = 0; i < mvlist.Size(); ++i)
+	{
+		Move mv = mvlist[i].m_mv;
+		if (!pos.MakeMove(mv))
+			continue;
+
+		++g_mateNodes;
+
+		MateChild child;
+		child.m_mv = mv;
+		child.m_key = MateKey(pos, remaining - 1);
+		child.m_work = 0;
+
+		if (remaining == 1)
+		{
+			// the attacker's last move, only a mate counts
+			bool mate = pos.InCheck() && !HasLegalMove(pos, g_mateMoves[ply + 1]);
+			child.m_pn = mate? 0 : PN_INFINITY;
+			child.m_dn = mate? PN_INFINITY : 0;
+		}
+		else
+		{
+			// checks are the likeliest way to mate
+			child.m_pn = (orNode && !pos.InCheck())? 2 : 1;
+			child.m_dn = 1;
+		}
+
+		pos.UnmakeMove();
+		children.push_back(child);
+
+		if (remaining == 1 && child.m_pn == 0)
+			break;
+	}
+
+	PN pn = orNode? PN_INFINITY : 0;
+	PN dn = orNode? 0 : PN_INFINITY;
+	size_t best = 0;
+
+	if (children.empty() && !orNode && !pos.InCheck())
+	{
+		// stalemate
+		pn = PN_INFINITY;
+		dn = 0;
+	}
+
+	while (!children.empty())
+	{
+		pn = orNode? PN_INFINITY : 0;
+		dn = orNode? 0 : PN_INFINITY;
+		PN second = PN_INFINITY;
+		best = 0;
+
+		for (size_t i = 0; i < children.size(); ++i)
+		{
+			MateChild& child = children[i];
+			if (remaining > 1)
+			{
+				const MateEntry* pEntry = ProbeMate(child.m_key);
+				if (pEntry != NULL)
+				{
+					child.m_pn = pEntry->m_pn;
+					child.m_dn = pEntry->m_dn;
+					child.m_work = pEntry->m_work;
+				}
+			}
+
+			if (orNode)
+			{
+				dn = AddPN(dn, child.m_dn);
+				if (child.m_pn < pn)
+				{
+					second = pn;
+					pn = child.m_pn;
+					best = i;
+				}
+				else if (child.m_pn < second)
+					second = child.m_pn;
+			}
+			else
+			{
+				pn = AddPN(pn, child.m_pn);
+				if (child.m_dn < dn)
+				{
+					second = dn;
+					dn = child.m_dn;
+					best = i;
+				}
+				else if (child.m_dn < second)
+					second = child.m_dn;
+			}
+		}
+
+		if (pn >= thPn || dn >= thDn || g_mateStop)
+			break;
+
+		//
+		//   The child gets as much room as keeps it the best one, with a
+		//   margin of a quarter (the 1 + epsilon trick) against switching
+		//   back and forth between two close siblings
+		//
+
+		MateChild& child = children[best];
+		PN childThPn = 0, childThDn = 0;
+
+		if (orNode)
+		{
+			childThPn = std::min(thPn, AddPN(second, second / 4 + 1));
+			childThDn = thDn - dn + child.m_dn;
+		}
+		else
+		{
+			childThPn = thPn - pn + child.m_pn;
+			childThDn = std::min(thDn, AddPN(second, second / 4 + 1));
+		}
+
+		pos.MakeMove(child.m_mv);
+		MateMID(child, ply + 1, remaining - 1, childThPn, childThDn);
+		pos.UnmakeMove();
+	}
+
+	NODES work = node.m_work + (g_mateNodes - startNodes);
+	node.m_pn = pn;
+	node.m_dn = dn;
+	node.m_work = static_cast<U32>(std::min(work, NODES(0xffffffff)));
+
+	RecordMate(node.m_key, pn, dn, node.m_work, children.empty()? Move() : children[best].m_mv);
+}
+////////////////////////////////////////////////////////////////////////////////
+
+static int ShortestMate(int ply, int maxMoves)
+{
+	for (int moves = 1; moves <= maxMoves && !g_mateStop; ++moves)
+	{
+		MateChild node;
+		node.m_key = MateKey(g_matePos, 2 * moves - 1);
+		node.m_pn = 1;
+		node.m_dn = 1;
+		node.m_work = 0;
+
+		MateMID(node, ply, 2 * moves - 1, PN_INFINITY, PN_INFINITY);
+		if (node.m_pn == 0)
+			return moves;
+	}
+	return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+static void ExtractMatePV(int moves, vector<Move>& pv)
+{
+	//
+	//   The hash table only tells that a line mates in time. To show the
+	//   main line, the defender picks the reply with the longest shortest
+	//   mate, and the attacker the move that proves the shortest one
+	//
+
+	Position& pos = g_matePos;
+	int ply = 0;
+	pv.clear();
+
+	while (moves > 0 && !g_mateStop)
+	{
+		const MateEntry* pEntry = ProbeMate(MateKey(pos, 2 * moves - 1));
+		if (pEntry == NULL || pEntry->m_pn != 0)
+			break;
+
+		Move mv(pEntry->m_mv);
+		if (mv.IsNull() || !pos.MakeMove(mv))
+			break;
+
+		pv.push_back(mv);
+		++ply;
+		--moves;
+
+		if (moves == 0)
+			break;
+
+		MoveList mvlist;
+		GenAllMoves(pos, mvlist);
+
+		Move longest;
+		int longestMoves = 0;
+
+		for (size_t i = 0; i < mvlist.Size(); ++i)
+		{
+			Move reply = mvlist[i].m_mv;
+			if (!pos.MakeMove(reply))
+				continue;
+
+			int replyMoves = ShortestMate(ply + 1, moves);
+			pos.UnmakeMove();
+
+			if (replyMoves > longestMoves)
+			{
+				longest = reply;
+				longestMoves = replyMoves;
+			}
+		}
+
+		if (longest.IsNull() || !pos.MakeMove(longest))
+			break;
+
+		pv.push_back(longest);
+		++ply;
+		moves = longestMoves;
+	}
+
+	for (size_t i = 0; i < pv.size(); ++i)
+		pos.UnmakeMove();
+
+	// a line cut short by the limits is of no use
+	if (g_mateStop)
+		pv.resize(std::min(pv.size(), size_t(1)));
+}
+////////////////////////////////////////////////////////////////////////////////
+
+static string MatePVToStr(const vector<Move>& pv)
+{
+	Position tmp = g_matePos;
+	int plyCount = tmp.Ply();
+	stringstream ss;
+
+	if (tmp.Side() == BLACK)
+	{
+		if (plyCount == 0)
+			++plyCount;
+		ss << plyCount / 2 + 1 << ". ... ";
+	}
+
+	for (size_t m = 0; m < pv.size(); ++m)
+	{
+		Move mv = pv[m];
+		MoveList mvlist;
+		GenAllMoves(tmp, mvlist);
+		if (tmp.Side() == WHITE)
+			ss << plyCount / 2 + 1 << ". ";
+		++plyCount;
+		ss << MoveToStrShort(mv, tmp, mvlist);
+		if (!tmp.MakeMove(mv))
+			break;
+		if (tmp.InCheck())
+			ss << ((m == pv.size() - 1)? "#" : "+");
+		if (m < pv.size() - 1)
+			ss << " ";
+	}
+
+	return ss.str();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+static void PrintMateInfo(int moves, const MateResult& result)
+{
+	U64 time = result.time;
+	NODES nodes = result.nodes;
+	NODES nps = (time > 0)? 1000 * nodes / static_cast<NODES>(time) : 0;
+
+	if (g_uci)
+	{
+		stringstream ss;
+		ss << "info depth " << 2 * moves - 1;
+		if (result.moves > 0)
+			ss << " score mate " << result.moves;
+		ss << " nodes " << nodes << " time " << time << " nps " << nps;
+		if (!result.pv.empty())
+		{
+			ss << " pv";
+			for (size_t i = 0; i < result.pv.size(); ++i)
+				ss << " " << MoveToStrLong(result.pv[i]);
+		}
+		Out("%s\n", ss.str().c_str());
+	}
+	else if (result.moves > 0)
+	{
+		Out("Mate in %d: %s\n", result.moves, MatePVToStr(result.pv).c_str());
+		Out("Nodes: %lld, time: %d ms\n", static_cast<long long>(nodes), static_cast<int>(time));
+	}
+	else
+	{
+		Out("No mate in %d, nodes: %lld, time: %d ms\n",
+			moves,
+			static_cast<long long>(nodes),
+			static_cast<int>(time));
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void SetMateHashSize(double mb)
+{
+	// allocated by the first mate search, most sessions never run one
+	g_mateHashMb = mb;
+	g_mateHash.clear();
+	g_mateHashSize = 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void StartMateSearch(const Position& pos, const MateParams& params, MateResult& result)
+{
+	if (g_mateHash.empty())
+	{
+		size_t Nmax = static_cast<size_t>(1024 * 1024 * g_mateHashMb / sizeof(MateEntry));
+
+		g_mateHashSize = 2;
+		while (2 * g_mateHashSize <= Nmax)
+			g_mateHashSize *= 2;
+
+		g_mateHash.assign(g_mateHashSize, MateEntry());
+		g_mateAge = 0;
+	}
+
+	// entries of earlier searches stay valid but may be replaced freely
+	if (++g_mateAge == 0)
+		++g_mateAge;
+
+	g_matePos = pos;
+	g_mateParams = params;
+	g_mateNodes = 0;
+	g_nextMateCheck = 0;
+	g_mateStartTime = GetMonotonicTime();
+	g_mateStop = false;
+	SetSearching(true);
+
+	result = MateResult();
+	int maxMoves = std::min(std::max(1, params.maxMoves), MAX_MATE_MOVES);
+
+	for (int moves = 1; moves <= maxMoves; ++moves)
+	{
+		int remaining = 2 * moves - 1;
+
+		MateChild root;
+		root.m_key = MateKey(g_matePos, remaining);
+		root.m_pn = 1;
+		root.m_dn = 1;
+		root.m_work = 0;
+
+		MateMID(root, 0, remaining, PN_INFINITY, PN_INFINITY);
+
+		const MateEntry* pEntry = ProbeMate(root.m_key);
+		if (pEntry != NULL && pEntry->m_mv != 0)
+			result.bestMove = Move(pEntry->m_mv);
+
+		if (root.m_pn == 0)
+		{
+			result.moves = moves;
+			ExtractMatePV(moves, result.pv);
+		}
+
+		result.nodes = g_mateNodes;
+		result.time = GetMonotonicTime() - g_mateStartTime;
+
+		if (g_mateStop && result.moves == 0)
+			break;
+
+		if (!params.silent && (g_uci || result.moves > 0 || moves == maxMoves))
+			PrintMateInfo(moves, result);
+
+		if (result.moves > 0)
+			break;
+	}
+
+	SetSearching(false);
+
+	if (g_mateStop && result.moves == 0 && !params.silent && !g_uci)
+		Out("Mate search stopped, nodes: %lld, time: %d ms\n",
+			static_cast<long long>(result.nodes),
+			static_cast<int>(result.time));
+}
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,46 @@
+//   GreKo chess engine
+//   (c) 2002-2021 Vladimir Medvedev <vrm@bk.ru>
+//   http://greko.su
+
+#ifndef MATE_H
+#define MATE_H
+
+#include "position.h"
+
+const int DEFAULT_MATE_HASH_SIZE = 16;
+const int MAX_MATE_MOVES = 64;
+
+struct MateParams
+{
+	MateParams() :
+		maxMoves(1),
+		maxNodes(0),
+		maxTime(0),
+		silent(false) {}
+
+	int   maxMoves;   // longest mate looked for, in moves of the side to move
+	NODES maxNodes;   // 0 = no limit
+	U64   maxTime;    // ms, 0 = no limit
+	bool  silent;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+struct MateResult
+{
+	MateResult() :
+		moves(0),
+		nodes(0),
+		time(0) {}
+
+	int          moves;      // 0 if no mate was proven
+	Move         bestMove;   // mating move, or the most promising try
+	vector<Move> pv;
+	NODES        nodes;
+	U64          time;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+void SetMateHashSize(double mb);
+void StartMateSearch(const Position& pos, const MateParams& params, MateResult& result);
+
+#endif
@@ -6,7 +6,7 @@
 #include "position.h"
 #include "utils.h"
 
-extern Pair PSQ[14][64];
+extern IntPair PSQ_INT[14][64];
 
 const Move MOVE_O_O[2]   = { Move(E1, G1, KW), Move(E8, G8, KB) };
 const Move MOVE_O_O_O[2] = { Move(E1, C1, KW), Move(E8, C8, KB) };
@@ -16,6 +16,9 @@ U64 Position::s_hashSide[2];
 U64 Position::s_hashCastlings[256];
 U64 Position::s_hashEP[256];
 
+U64  Position::s_cuckooKeys[Position::CUCKOO_SIZE];
+Move Position::s_cuckooMoves[Position::CUCKOO_SIZE];
+
 bool Position::CanCastle(COLOR side, U8 flank) const
 {
 	if (InCheck())
@@ -52,15 +55,16 @@ void Position::Clear()
 	m_castlings = 0;
 	m_ep = NF;
 	m_fifty = 0;
+	m_fromNull = 0;
 	m_hash = LL(0x8000000000000000);
 	m_inCheck = false;
 	m_Kings[WHITE] = m_Kings[BLACK] = NF;
 	m_matIndex[WHITE] = m_matIndex[BLACK] = 0;
 	m_ply = 0;
-	m_population = 0;
-	m_score[WHITE] = m_score[BLACK] = Pair();
+	m_score[WHITE] = m_score[BLACK] = IntPair();
 	m_side = WHITE;
 	m_undos.clear();
+	m_keys.clear();
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -133,6 +137,77 @@ U64 Position::Hash() const
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+bool Position::HasUpcomingRepetition(int ply) const
+{
+	//
+	//   Detects that the side to move has a reversible move leading to
+	//   a position already seen inside the search tree (cuckoo hashing,
+	//   after M. Kempe and Stockfish)
+	//
+
+	int end = std::min(m_fifty, m_fromNull);
+	if (end < 3)
+		return false;
+
+	U64 hash0 = Hash();
+	U64 occ = BitsAll();
+	size_t n = m_keys.size();
+
+	for (int i = 3; i <= end && i < ply; i += 2)
+	{
+		U64 moveKey = hash0 ^ m_keys[n - i];
+
+		int j = CuckooH1(moveKey);
+		if (s_cuckooKeys[j] != moveKey)
+		{
+			j = CuckooH2(moveKey);
+			if (s_cuckooKeys[j] != moveKey)
+				continue;
+		}
+
+		Move mv = s_cuckooMoves[j];
+		if ((BB_BETWEEN[mv.From()][mv.To()] & occ) == 0)
+			return true;
+	}
+	return false;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void Position::InitCuckoo()
+{
+	memset(s_cuckooKeys, 0, sizeof(s_cuckooKeys));
+	for (int i = 0; i < CUCKOO_SIZE; ++i)
+		s_cuckooMoves[i] = Move(0);
+
+	int count = 0;
+	for (PIECE p = KNIGHT; p < 14; ++p)
+	{
+		for (FLD from = 0; from < 64; ++from)
+		{
+			for (FLD to = from + 1; to < 64; ++to)
+			{
+				if ((Attacks(from, 0, p) & BB_SINGLE[to]) == 0)
+					continue;
+
+				Move mv(from, to, p);
+				U64 key = s_hash[from][p] ^ s_hash[to][p] ^ s_hashSide[WHITE] ^ s_hashSide[BLACK];
+				int i = CuckooH1(key);
+				while (1)
+				{
+					std::swap(s_cuckooKeys[i], key);
+					std::swap(s_cuckooMoves[i], mv);
+					if (mv.IsNull())
+						break;
+					i = (i == CuckooH1(key))? CuckooH2(key) : CuckooH1(key);
+				}
+				++count;
+			}
+		}
+	}
+	assert(count == 3668);
+}
+////////////////////////////////////////////////////////////////////////////////
+
 void Position::InitHashNumbers()
 {
 	RandSeed(30147);
@@ -153,6 +228,8 @@ void Position::InitHashNumbers()
 		s_hashCastlings[i] = Rand64() & PIECE_HASH_MASK;
 		s_hashEP[i] = Rand64() & PIECE_HASH_MASK;
 	}
+
+	InitCuckoo();
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -193,10 +270,11 @@ bool Position::MakeMove(Move mv)
 	undo.m_castlings = m_castlings;
 	undo.m_ep = m_ep;
 	undo.m_fifty = m_fifty;
-	undo.m_hash = Hash();
+	undo.m_fromNull = m_fromNull;
 	undo.m_inCheck = m_inCheck;
 	undo.m_mv = mv;
 	m_undos.push_back(undo);
+	m_keys.push_back(Hash());
 
 	FLD from = mv.From();
 	FLD to = mv.To();
@@ -208,6 +286,7 @@ bool Position::MakeMove(Move mv)
 	COLOR opp = side ^ 1;
 
 	++m_fifty;
+	++m_fromNull;
 	if (captured)
 	{
 		m_fifty = 0;
@@ -286,12 +365,14 @@ void Position::MakeNullMove()
 	undo.m_castlings = m_castlings;
 	undo.m_ep = m_ep;
 	undo.m_fifty = m_fifty;
-	undo.m_hash = Hash();
+	undo.m_fromNull = m_fromNull;
 	undo.m_inCheck = m_inCheck;
 	undo.m_mv = Move(0);
 	m_undos.push_back(undo);
+	m_keys.push_back(Hash());
 
 	m_ep = NF;
+	m_fromNull = 0;
 	m_inCheck = false;
 
 	++m_ply;
@@ -341,8 +422,8 @@ void Position::MovePiece(PIECE p, FLD from, FLD to)
 	m_hash ^= s_hash[from][p];
 	m_hash ^= s_hash[to][p];
 
-	m_score[side] -= PSQ[p][from];
-	m_score[side] += PSQ[p][to];
+	m_score[side] -= PSQ_INT[p][from];
+	m_score[side] += PSQ_INT[p][to];
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -383,12 +464,11 @@ void Position::Put(FLD f, PIECE p)
 	m_bitsAll[side] ^= BB_SINGLE[f];
 	m_board[f] = p;
 
-	++m_population;
 	++m_count[p];
 
 	m_hash ^= s_hash[f][p];
 	m_matIndex[side] += DELTA_M[p];
-	m_score[side] += PSQ[p][f];
+	m_score[side] += PSQ_INT[p][f];
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -403,32 +483,30 @@ void Position::Remove(FLD f)
 	m_bitsAll[side] ^= BB_SINGLE[f];
 	m_board[f] = NOPIECE;
 
-	--m_population;
 	--m_count[p];
 
 	m_hash ^= s_hash[f][p];
 	m_matIndex[side] -= DELTA_M[p];
-	m_score[side] -= PSQ[p][f];
+	m_score[side] -= PSQ_INT[p][f];
 }
 ////////////////////////////////////////////////////////////////////////////////
 
 int Position::Repetitions() const
 {
+	//
+	//   Only positions after the last irreversible move or null move can
+	//   repeat, and only those with the same side to move
+	//
+
 	int r = 1;
 	U64 hash0 = Hash();
+	int end = std::min(m_fifty, m_fromNull);
+	size_t n = m_keys.size();
 
-	for (int i = (int)m_undos.size() - 1; i >= 0; --i)
+	for (int i = 4; i <= end; i += 2)
 	{
-		if (m_undos[i].m_hash == hash0)
+		if (m_keys[n - i] == hash0)
 			++r;
-
-		Move mv = m_undos[i].m_mv;
-		if (mv.IsNull())
-			break;
-		if (mv.Captured())
-			break;
-		if (mv.Piece() <= PB)
-			break;
 	}
 	return r;
 }
@@ -586,6 +664,19 @@ void Position::SetInitial()
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+void Position::SetState(const PositionState& state)
+{
+	//
+	//   The copy brings no key history, so repetition scans must not
+	//   look behind the restored position
+	//
+
+	Clear();
+	static_cast<PositionState&>(*this) = state;
+	m_fromNull = 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+
 void Position::UnmakeMove()
 {
 	if (m_undos.empty())
@@ -601,9 +692,11 @@ void Position::UnmakeMove()
 	m_castlings = undo.m_castlings;
 	m_ep = undo.m_ep;
 	m_fifty = undo.m_fifty;
+	m_fromNull = undo.m_fromNull;
 	m_inCheck = undo.m_inCheck;
 
 	m_undos.pop_back();
+	m_keys.pop_back();
 
 	COLOR opp = m_side;
 	COLOR side = opp ^ 1;
@@ -652,9 +745,11 @@ void Position::UnmakeNullMove()
 	m_castlings = undo.m_castlings;
 	m_ep = undo.m_ep;
 	m_fifty = undo.m_fifty;
+	m_fromNull = undo.m_fromNull;
 	m_inCheck = undo.m_inCheck;
 
 	m_undos.pop_back();
+	m_keys.pop_back();
 
 	--m_ply;
 	m_side ^= 1;
@@ -5,6 +5,10 @@
 #ifndef POSITION_H
 #define POSITION_H
 
+#ifndef SINGLE_THREAD
+#include <type_traits>
+#endif
+
 #include "bitboards.h"
 
 enum
@@ -62,7 +66,35 @@ const int PIECE_HASH_BITS = 64 - PAWN_HASH_BITS;
 const U64 PAWN_HASH_MASK = (U64(1) << PAWN_HASH_BITS) - 1;
 const U64 PIECE_HASH_MASK = (U64(1) << PIECE_HASH_BITS) - 1;
 
-class Position
+//   Everything MakeMove/UnmakeMove touch on every node, packed so that a
+//   position fits in four cache lines and can be copied with memcpy
+
+struct PositionState
+{
+	U64     m_bits[14];
+	U64     m_bitsAll[2];
+	U64     m_hash;
+	IntPair m_score[2];
+	PIECE   m_board[64];
+	U8      m_count[14];
+	U8      m_matIndex[2];
+	I16     m_ply;
+	I16     m_fifty;
+	I16     m_fromNull;
+	U8      m_castlings;
+	FLD     m_ep;
+	FLD     m_Kings[2];
+	COLOR   m_side;
+	bool    m_inCheck;
+};
+
+#ifndef SINGLE_THREAD
+static_assert(std::is_trivially_copyable<PositionState>::value, "PositionState must be trivially copyable");
+static_assert(sizeof(PositionState) <= 256, "PositionState must fit in four cache lines");
+#endif
+////////////////////////////////////////////////////////////////////////////////
+
+class Position : private PositionState
 {
 public:
 	U64    Bits(PIECE p) const { return m_bits[p]; }
@@ -75,6 +107,7 @@ public:
 	string FEN() const;
 	int    Fifty() const { return m_fifty; }
 	U64    Hash() const;
+	bool   HasUpcomingRepetition(int ply) const;
 	bool   InCheck() const { return m_inCheck; }
 	bool   IsAttacked(FLD f, COLOR side) const;
 	FLD    King(COLOR side) const { return m_Kings[side]; }
@@ -85,11 +118,13 @@ public:
 	void   Mirror();
 	U32    PawnHash() const { return U32((m_hash >> PIECE_HASH_BITS) & PAWN_HASH_MASK); }
 	int    Ply() const { return m_ply; }
+	Move   PrevMove() const { return m_undos.size() < 2? Move(0) : m_undos[m_undos.size() - 2].m_mv; }
 	void   Print() const;
 	int    Repetitions() const;
-	Pair   Score(COLOR side) const { return m_score[side]; }
+	Pair   Score(COLOR side) const { return Pair(m_score[side].mid, m_score[side].end); }
 	bool   SetFEN(const string& fen);
 	void   SetInitial();
+	void   SetState(const PositionState& state);
 	COLOR  Side() const { return m_side; }
 
 	Pair   Stage() const
@@ -104,7 +139,9 @@ public:
 	void   UpdateCheckInfo() { m_inCheck = IsAttacked(King(m_side), m_side ^ 1); }
 
 	const PIECE& operator[] (FLD f) const { return m_board[f]; }
+	const PositionState& State() const { return *this; }
 
+	static void  InitCuckoo();
 	static void  InitHashNumbers();
 
 private:
@@ -118,32 +155,27 @@ private:
 	static U64 s_hashCastlings[256];
 	static U64 s_hashEP[256];
 
-	U64   m_bits[14];
-	U64   m_bitsAll[2];
-	PIECE m_board[64];
-	U8    m_castlings;
-	int   m_count[14];
-	FLD   m_ep;
-	int   m_fifty;
-	U64   m_hash;
-	bool  m_inCheck;
-	FLD   m_Kings[2];
-	int   m_matIndex[2];
-	int   m_ply;
-	int   m_population;
-	Pair  m_score[2];
-	COLOR m_side;
+	// cuckoo tables of reversible moves, indexed by hash difference;
+	// piece keys are only 32 bits wide and the lowest bits of Rand64()
+	// are weak, hence the shifts
+	static const int CUCKOO_SIZE = 8192;
+	static U64  s_cuckooKeys[CUCKOO_SIZE];
+	static Move s_cuckooMoves[CUCKOO_SIZE];
+
+	static int CuckooH1(U64 key) { return int((key >> 19) & (CUCKOO_SIZE - 1)); }
+	static int CuckooH2(U64 key) { return int((key >> 6) & (CUCKOO_SIZE - 1)); }
 
 	struct Undo
 	{
 		U8   m_castlings;
 		FLD  m_ep;
-		int  m_fifty;
-		U64  m_hash;
+		I16  m_fifty;
+		I16  m_fromNull;
 		bool m_inCheck;
 		Move m_mv;
 	};
 	vector<Undo> m_undos;
+	vector<U64>  m_keys;   // Hash() before each move, parallel to m_undos
 };
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -14,6 +14,8 @@ extern deque<string> g_queue;
 extern bool g_console;
 extern bool g_xboard;
 extern bool g_uci;
+extern bool g_debug;
+extern FILE* g_telemetry;
 
 SearchParams Search::s_params;
 SearchResults Search::s_results;
@@ -23,14 +25,34 @@ EVAL         Search::s_beta;
 HashEntry*   Search::s_hash = NULL;
 U8           Search::s_hashAge = 0;
 size_t       Search::s_hashFull = 0;
+bool         Search::s_hashInterleave = false;
 size_t       Search::s_hashSize = 0;
 U64          Search::s_hashMask = 0;
 int          Search::s_iter = 0;
 U64          Search::s_startTime = 0;
+double       Search::s_instability = 0;
+bool         Search::s_deterministic = false;
+size_t       Search::s_shardSize = 0;
+vector<NODES> Search::s_iterNodes;
 int          Search::s_numThreads = 1;
 Position     Search::s_pos;
 EVAL         Search::s_score;
-SearchThread Search::s_threads[MAX_NUM_THREADS];
+bool         Search::s_threadAffinity = true;
+
+U32               Search::s_generation = 0;
+int               Search::s_busy = 0;
+bool              Search::s_quit = false;
+#ifndef SINGLE_THREAD
+std::atomic<bool>       Search::s_stop(true);
+std::mutex              Search::s_poolMutex;
+std::condition_variable Search::s_poolCv;
+std::condition_variable Search::s_doneCv;
+vector<std::thread>     Search::s_helpers;
+#else
+bool                    Search::s_stop = true;
+#endif
+
+vector<SearchThread*> Search::s_threads;
 
 enum SortType
 {
@@ -38,9 +60,10 @@ enum SortType
 	SORT_CAPTURE     = 5000000,
 	SORT_MATE_KILLER = 4000000,
 	SORT_KILLER      = 3000000,
-	SORT_REFUTATION  = 2000000,
+	SORT_COUNTER     = 2000000,
 	SORT_MAX_HISTORY = 1000000,
-	SORT_OTHER       = 0
+	SORT_OTHER       = 0,
+	SORT_BAD_CAPTURE = -2000000
 };
 
 enum NodeType
@@ -49,14 +72,18 @@ enum NodeType
 	NODE_NON_PV = 1
 };
 
-const EVAL WINDOW_ROOT = 100;
 
 const int USE_FUTILITY[]                = { 0, 1 };
+const int USE_RAZORING[]                = { 0, 1 };
+const int USE_PROBCUT[]                 = { 0, 1 };
 const int USE_NULLMOVE[]                = { 0, 1 };
 const int USE_LMR[]                     = { 0, 1 };
 const int USE_PAWN_7TH_EXTENSIONS[]     = { 1, 1 };
 const int USE_RECAPTURE_EXTENSIONS[]    = { 1, 1 };
 const int USE_SINGLE_REPLY_EXTENSIONS[] = { 1, 1 };
+const int USE_SINGULAR_EXTENSIONS[]     = { 1, 1 };
+const int USE_LMP[]                     = { 0, 1 };
+const int USE_SEE_QUIET_PRUNING[]       = { 0, 1 };
 const int USE_IID[]                     = { 1, 1 };
 const int USE_SEE_PRUNING[]             = { 1, 1 };
 const int USE_MATE_PRUNING[]            = { 1, 1 };
@@ -64,9 +91,13 @@ const int USE_HASH_EXACT_EVAL[]         = { 1, 1 };
 const int USE_HASH_PRUNING[]            = { 1, 1 };
 const int USE_QCHECKS[]                 = { 1, 1 };
 
-const EVAL FUTILITY_MARGIN_ALPHA[] = { 0, 50, 350, 550 };
 const EVAL FUTILITY_MARGIN_BETA[]  = { 0, 50, 350, 550 };
 
+const int RAZOR_MAX_DEPTH = 3;
+
+const int PROBCUT_MIN_DEPTH = 5;
+const int PROBCUT_REDUCTION = 4;
+
 const int NULLMOVE_MIN_DEPTH = 2;
 const int NULLMOVE_BASE_R = 3;
 const double NULLMOVE_DEPTH_DIVISOR = 6.0;
@@ -76,15 +107,64 @@ const int LMR_MIN_DEPTH = 4;
 const int LMR_MIN_MOVE = 3;
 const double LMR_DEPTH_DIVISOR = 10.0;
 const double LMR_MOVE_DIVISOR = 10.0;
-const int LMR_MAX_SUCCESS_RATE = 50;
+const int LMR_HISTORY_DIVISOR = 8192;
+const int LMR_HISTORY_MAX_ADJUST = 2;   // plies either way
+
+const int LMP_MAX_DEPTH = 8;
+
+const int SEE_QUIET_MAX_DEPTH = 6;
+const EVAL SEE_QUIET_MARGIN_PER_PLY = 60;
+
+const int SINGULAR_MIN_DEPTH = 8;
+const int SINGULAR_HASH_DEPTH_MARGIN = 3;
+const EVAL SINGULAR_MARGIN_PER_PLY = 2;
+
+const int HISTORY_BONUS_MAX = 2048;
+const int MAX_QUIETS_TRIED = 64;
+const int MAX_CAPTURES_TRIED = 32;
 
 const int SEE_PRUNING_MIN_QPLY = 0;
 
+const EVAL VOTE_SCORE_OFFSET = 14;
+
+const NODES NODES_SUM_INTERVAL = 256;
+const NODES INPUT_CHECK_INTERVAL = 8192;   // without the input thread
+
+const size_t MIN_SHARD_SIZE = 4096;
+const size_t MAX_SHARD_SIZE = 1 << 20;
+
+//
+//   Iteration schedule of the helpers, repeating every HELPER_SKIP_CYCLE
+//   threads: each one searches a run of HELPER_SKIP_SIZE depths, then
+//   skips as many, starting HELPER_SKIP_PHASE depths in. Thread ids past
+//   the cycle reuse it, so every helper starts within a few plies
+//
+
+const int HELPER_SKIP_CYCLE = 20;
+const int HELPER_SKIP_SIZE[HELPER_SKIP_CYCLE]  = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+const int HELPER_SKIP_PHASE[HELPER_SKIP_CYCLE] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
+
+const double TM_INSTABILITY_DECAY  = 0.5;    // per iteration
+const double TM_INSTABILITY_WEIGHT = 0.5;
+const EVAL   TM_SCORE_DROP_MAX     = 100;
+const double TM_SCORE_DROP_WEIGHT  = 0.5;    // at TM_SCORE_DROP_MAX
+const double TM_MIN_BRANCHING      = 1.5;
+const double TM_MAX_BRANCHING      = 4.0;
+const double TM_MAX_OVERRUN        = 2.0;
+
+const NODES TIME_CHECK_PERIOD    = 1;       // ms
+const NODES TIME_CHECK_MIN_NODES = 64;
+const NODES TIME_CHECK_MAX_NODES = 16384;
+
 static const EVAL SEE_VALUE[14] =
 {
 	0, 0, 100, 100, 300, 300, 300, 300, 500, 500, 900, 900, 20000, 20000
 };
 
+// sliders that may stand behind a piece which has just left the exchange square's lines
+static const bool SEE_XRAY_BISHOP[14] = { 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 1, 1 };
+static const bool SEE_XRAY_ROOK[14]   = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1 };
+
 void Search::ClearHash()
 {
 	assert(s_hash != NULL);
@@ -95,6 +175,13 @@ void Search::ClearHash()
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+void Search::ClearHistory()
+{
+	for (size_t i = 0; i < s_threads.size(); ++i)
+		s_threads[i]->ClearHistory();
+}
+////////////////////////////////////////////////////////////////////////////////
+
 int Search::CountLegalMoves(Position& pos, const MoveList& mvlist, int upperLimit)
 {
 	int legalMoves = 0;
@@ -115,13 +202,13 @@ int Search::CountLegalMoves(Position& pos, const MoveList& mvlist, int upperLimi
 
 U64 Search::CurrentSearchTime()
 {
-	return GetProcTime() - s_startTime;
+	return GetMonotonicTime() - s_startTime;
 }
 ////////////////////////////////////////////////////////////////////////////////
 
 Move Search::GetRandomMove(Position& pos)
 {
-	SearchThread& thread = s_threads[0];
+	SearchThread& thread = *s_threads[0];
 	thread.NewSearch(pos);
 	EVAL e0 = thread.AlphaBeta(-INFINITY_SCORE, INFINITY_SCORE, 1, 0);
 
@@ -154,18 +241,92 @@ Move Search::GetRandomMove(Position& pos)
 
 void Search::InitThreads(int numThreads)
 {
-	for (int i = 1; i < s_numThreads; ++i)
-		s_threads[i].Quit();
+	//
+	//   Helpers are created from scratch, and each of them allocates its
+	//   own SearchThread after being pinned to its CPU, so that its tables
+	//   live in the memory of that CPU's node
+	//
+
+	QuitThreads();
+	for (size_t i = 1; i < s_threads.size(); ++i)
+		delete s_threads[i];
 
 	if (numThreads > MAX_NUM_THREADS)
 		numThreads = MAX_NUM_THREADS;
 	if (numThreads < 1)
 		numThreads = 1;
 
+	if (s_threads.empty())
+	{
+		s_threads.push_back(new SearchThread);
+		s_threads[0]->ClearHistory();
+	}
+	s_threads.resize(1);
+	s_threads.resize(numThreads, NULL);
 	s_numThreads = numThreads;
 
+#ifndef SINGLE_THREAD
+	{
+		std::lock_guard<std::mutex> lock(s_poolMutex);
+		s_quit = false;
+		s_busy = s_numThreads - 1;
+	}
+
 	for (int i = 1; i < s_numThreads; ++i)
-		s_threads[i].Init(i);
+		s_helpers.push_back(std::thread(&SearchThread::HelperMain, i));
+#endif
+
+	// wait until every helper has set up its memory
+	WaitHelpers();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+bool Search::DeterministicBarrier()
+{
+	//
+	//   End of a round: every thread has stopped, their private hash
+	//   writes go to the shared table in thread order. Returns false
+	//   when a thread ran out of its node budget, then no round follows
+	//
+
+#ifndef SINGLE_THREAD
+	WaitHelpers();
+#endif
+
+	bool outOfNodes = false;
+	for (int i = 0; i < s_numThreads; ++i)
+	{
+		s_threads[i]->MergeShard();
+		if (s_threads[i]->OutOfNodes())
+			outOfNodes = true;
+	}
+
+	return !outOfNodes;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void Search::DeterministicRelease()
+{
+	//
+	//   Start of a round: what is left of the node limit is split evenly,
+	//   each helper makes one step of its own iteration schedule
+	//
+
+	NODES nodes = TotalNodes();
+	NODES remaining = (nodes < s_params.maxNodes)? s_params.maxNodes - nodes : 0;
+	NODES budget = std::max(remaining / s_numThreads, NODES(1));
+
+	for (int i = 0; i < s_numThreads; ++i)
+		s_threads[i]->SetNodeBudget(budget);
+
+#ifndef SINGLE_THREAD
+	{
+		std::lock_guard<std::mutex> lock(s_poolMutex);
+		s_busy = s_numThreads - 1;
+		++s_generation;
+	}
+	s_poolCv.notify_all();
+#endif
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -249,11 +410,67 @@ NODES Search::Perft(Position& pos, int depth, int ply)
 }
 ////////////////////////////////////////////////////////////////////////////////
 
-void Search::PrintPV(int multipv)
+const SearchThread* Search::PickBestThread()
+{
+	//
+	//   Every thread votes for the first move of its last completed PV,
+	//   weighted by depth and by score above the worst one, so that
+	//   helpers that got deeper can overrule the main thread
+	//
+
+	const SearchThread* best = s_threads[0];
+	EVAL minScore = best->m_completedScore;
+	map<U32, I64> votes;
+
+	for (int i = 0; i < s_numThreads; ++i)
+	{
+		const SearchThread* th = s_threads[i];
+		if (th->m_completedDepth > 0 && !th->m_completedPV.empty())
+			minScore = std::min(minScore, th->m_completedScore);
+	}
+
+	for (int i = 0; i < s_numThreads; ++i)
+	{
+		const SearchThread* th = s_threads[i];
+		if (th->m_completedDepth > 0 && !th->m_completedPV.empty())
+			votes[th->m_completedPV[0].ToInt()] +=
+				I64(th->m_completedScore - minScore + VOTE_SCORE_OFFSET) * th->m_completedDepth;
+	}
+
+	if (best->m_completedPV.empty())
+		return best;
+
+	for (int i = 1; i < s_numThreads; ++i)
+	{
+		const SearchThread* th = s_threads[i];
+		if (th->m_completedDepth == 0 || th->m_completedPV.empty())
+			continue;
+
+		EVAL score = th->m_completedScore;
+		EVAL bestScore = best->m_completedScore;
+
+		if (std::abs(bestScore) > CHECKMATE_SCORE - MAX_PLY)
+		{
+			// shortest mate, or longest resistance
+			if (score > bestScore)
+				best = th;
+		}
+		else if (score > CHECKMATE_SCORE - MAX_PLY ||
+			(score > -CHECKMATE_SCORE + MAX_PLY &&
+			votes[th->m_completedPV[0].ToInt()] > votes[best->m_completedPV[0].ToInt()]))
+		{
+			best = th;
+		}
+	}
+
+	return best;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void Search::PrintPV(const SearchThread& thread, const vector<Move>& pv, int depth, EVAL score, int multipv)
 {
-	const SearchThread& thread = s_threads[0];
-	const vector<Move>& pv = thread.m_pvs[0];
 	U64 time = CurrentSearchTime();
+	NODES nodes = TotalNodes();
 
 	if (pv.empty())
 		return;
@@ -262,12 +479,13 @@ void Search::PrintPV(int multipv)
 	if (!g_uci)
 	{
 		ss <<
-			setw(2) << s_iter <<
-			setw(8) << s_score <<
+			setw(2) << depth <<
+			setw(8) << score <<
 			setw(10) << time / 10 <<
-			setw(12) << thread.m_nodes;
+			setw(12) << nodes;
 		ss << "   ";
-		Position tmp = s_pos;
+		Position tmp;
+		tmp.SetState(s_pos.State());
 		int plyCount = tmp.Ply();
 
 		if (tmp.Side() == BLACK)
@@ -290,21 +508,21 @@ void Search::PrintPV(int multipv)
 				break;
 			if (tmp.InCheck())
 			{
-				if (s_score + m + 1 == CHECKMATE_SCORE)
+				if (score + m + 1 == CHECKMATE_SCORE)
 					ss << "#";
-				else if (s_score - (int)m + 1 == -CHECKMATE_SCORE)
+				else if (score - (int)m + 1 == -CHECKMATE_SCORE)
 					ss << "#";
 				else
 					ss << "+";
 			}
 			if (m == 0)
 			{
-				if (s_score >= s_beta)
+				if (score >= s_beta)
 				{
 					ss << "!";
 					break;
 				}
-				else if (s_score <= s_alpha)
+				else if (score <= s_alpha)
 					ss << "?";
 			}
 			if (m < pv.size() - 1)
@@ -313,18 +531,26 @@ void Search::PrintPV(int multipv)
 	}
 	else
 	{
-		ss << "info depth " << s_iter;
+		ss << "info depth " << depth;
 		ss << " seldepth " << thread.m_selDepth;
 
-		if (s_score > CHECKMATE_SCORE - 50 && s_score <= CHECKMATE_SCORE)
-			ss << " score mate " << (CHECKMATE_SCORE - s_score) / 2 + 1;
-		else if (s_score < -CHECKMATE_SCORE + 50 && s_score >= -CHECKMATE_SCORE)
-			ss << " score mate " << (-CHECKMATE_SCORE - s_score) / 2;
+		if (score > CHECKMATE_SCORE - 50 && score <= CHECKMATE_SCORE)
+			ss << " score mate " << (CHECKMATE_SCORE - score) / 2 + 1;
+		else if (score < -CHECKMATE_SCORE + 50 && score >= -CHECKMATE_SCORE)
+			ss << " score mate " << (-CHECKMATE_SCORE - score) / 2;
 		else
-			ss << " score cp " << s_score;
+			ss << " score cp " << score;
+
+		// printed after a failed root search as well
+		if (score >= s_beta)
+			ss << " lowerbound";
+		else if (score <= s_alpha)
+			ss << " upperbound";
 
 		ss << " time " << time;
-		ss << " nodes " << thread.m_nodes;
+		ss << " nodes " << nodes;
+		if (time > 0)
+			ss << " nps " << 1000 * nodes / time;
 
 		if (!pv.empty())
 		{
@@ -341,6 +567,111 @@ void Search::PrintPV(int multipv)
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+static double Percent(NODES part, NODES whole)
+{
+	return (whole > 0)? 100. * part / whole : 0.;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void Search::PrintStats()
+{
+	//
+	//   Counters of the last search summed over all threads, and the
+	//   effective branching factor of each completed iteration
+	//
+
+	SearchStats st;
+	NODES nodes = TotalNodes();
+	for (int i = 0; i < s_numThreads; ++i)
+		st.Add(s_threads[i]->m_stats);
+
+	Out("\n");
+	Out(" Nodes:              %llu\n", (unsigned long long)nodes);
+	Out(" Qsearch nodes:      %.1f%%\n", Percent(st.qNodes, nodes));
+	Out(" Qsearch hash hits:  %.1f%%\n", Percent(st.qHits, st.qProbes));
+	Out(" First move cutoffs: %.1f%% of %llu\n", Percent(st.firstMoveCutoffs, st.betaCutoffs), (unsigned long long)st.betaCutoffs);
+	Out(" Null move cutoffs:  %.1f%% of %llu\n", Percent(st.nullMoveCutoffs, st.nullMoveTries), (unsigned long long)st.nullMoveTries);
+	Out(" LMR re-searches:    %.1f%% of %llu\n", Percent(st.lmrResearches, st.lmrReductions), (unsigned long long)st.lmrReductions);
+	Out(" Futility prunes:    %llu\n", (unsigned long long)st.futilityPrunes);
+	Out(" Razor prunes:       %llu\n", (unsigned long long)st.razorPrunes);
+	Out(" Late move prunes:   %llu\n", (unsigned long long)st.lateMovePrunes);
+	Out(" SEE quiet prunes:   %llu\n", (unsigned long long)st.seeQuietPrunes);
+	Out(" ProbCuts:           %llu\n", (unsigned long long)st.probCuts);
+	Out(" Multi-cuts:         %llu\n", (unsigned long long)st.multiCuts);
+	Out(" Extensions:         %llu, singular %llu\n", (unsigned long long)st.extensions, (unsigned long long)st.singularExtensions);
+
+	Out(" Branching factor:  ");
+	for (size_t i = 2; i < s_iterNodes.size(); ++i)
+	{
+		NODES prev = s_iterNodes[i - 1] - s_iterNodes[i - 2];
+		NODES curr = s_iterNodes[i] - s_iterNodes[i - 1];
+		Out(" %.2f", (prev > 0)? static_cast<double>(curr) / prev : 0.);
+	}
+	Out("\n\n");
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void Search::PrintThreadStats()
+{
+	//
+	//   Per-thread speed, to spot helpers that are starved of CPU,
+	//   aspiration failures, to tune the window, and the share of
+	//   quiescence nodes found in the hash table
+	//
+
+	U64 time = CurrentSearchTime();
+	if (time == 0)
+		time = 1;
+
+	for (int i = 0; i < s_numThreads; ++i)
+	{
+		const SearchThread* th = s_threads[i];
+		NODES nodes = th->m_nodes.Get();
+		if (g_uci)
+			Out("info string thread %d nodes %llu nps %llu\n", i, (unsigned long long)nodes, (unsigned long long)(1000 * nodes / time));
+		else
+			Out(" thread %3d %12llu nodes %10llu nps\n", i, (unsigned long long)nodes, (unsigned long long)(1000 * nodes / time));
+
+		if (g_uci)
+			Out("info string thread %d aspiration fail high %d low %d\n", i, th->m_failHigh, th->m_failLow);
+		else
+			Out(" thread %3d aspiration fail high %d low %d\n", i, th->m_failHigh, th->m_failLow);
+
+		const SearchStats& st = th->m_stats;
+		double qHitRate = (st.qProbes > 0)? 100. * st.qHits / st.qProbes : 0.;
+		if (g_uci)
+			Out("info string thread %d qsearch hash probes %llu hits %.1f%%\n", i, (unsigned long long)st.qProbes, qHitRate);
+		else
+			Out(" thread %3d qsearch hash probes %llu hits %.1f%%\n", i, (unsigned long long)st.qProbes, qHitRate);
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+
+bool Search::KeepHashEntry(const HashEntry& entry, int depth)
+{
+	// quiescence results never displace main search results of this search
+	return depth <= HASH_DEPTH_QCHECKS &&
+		entry.GetDepth() > HASH_DEPTH_QCHECKS &&
+		entry.GetAge() == s_hashAge &&
+		!entry.IsEmpty();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void Search::MergeHash(U64 hash, const HashEntry& src)
+{
+	int index = static_cast<int>(hash & s_hashMask);
+	HashEntry& entry = s_hash[index];
+
+	if (KeepHashEntry(entry, src.GetDepth()))
+		return;
+
+	if (entry.IsEmpty())
+		++s_hashFull;
+
+	entry = src;
+}
+////////////////////////////////////////////////////////////////////////////////
+
 HashEntry* Search::ProbeHash(const Position& pos)
 {
 	assert(s_hash != NULL);
@@ -360,8 +691,40 @@ HashEntry* Search::ProbeHash(const Position& pos)
 
 void Search::QuitThreads()
 {
-	for (int i = 1; i < s_numThreads; ++i)
-		s_threads[i].Quit();
+#ifndef SINGLE_THREAD
+	RequestStop();
+	{
+		std::lock_guard<std::mutex> lock(s_poolMutex);
+		s_quit = true;
+	}
+	s_poolCv.notify_all();
+
+	for (size_t i = 0; i < s_helpers.size(); ++i)
+		s_helpers[i].join();
+	s_helpers.clear();
+#endif
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void Search::ReleaseHelpers(bool start)
+{
+	//
+	//   Clears the stop flag, and lets the helpers search unless they
+	//   are to wait for deterministic rounds
+	//
+
+	s_stop = false;
+	if (!start)
+		return;
+
+#ifndef SINGLE_THREAD
+	{
+		std::lock_guard<std::mutex> lock(s_poolMutex);
+		s_busy = s_numThreads - 1;
+		++s_generation;
+	}
+	s_poolCv.notify_all();
+#endif
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -374,9 +737,18 @@ void Search::RecordHash(const Position& pos, Move mv, EVAL score, int depth, int
 	int index = static_cast<int>(hash & s_hashMask);
 	HashEntry& entry = s_hash[index];
 
+	if (KeepHashEntry(entry, depth))
+		return;
+
 	if (entry.IsEmpty())
 		++s_hashFull;
 
+	RecordHash(entry, hash, mv, score, depth, ply, hashType);
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void Search::RecordHash(HashEntry& entry, U64 hash, Move mv, EVAL score, int depth, int ply, U8 hashType)
+{
 	entry.SetMove(mv);
 	entry.SetScore(score, ply);
 	entry.SetDepth(depth);
@@ -389,86 +761,162 @@ void Search::RecordHash(const Position& pos, Move mv, EVAL score, int depth, int
 
 EVAL Search::SEE(const Position& pos, Move mv)
 {
+	FLD to = mv.To();
 	COLOR side = GetColor(mv.Piece());
-	EVAL score = SEE_VALUE[mv.Captured()];
-	EVAL target = SEE_VALUE[mv.Piece()];
 	U64 occ = pos.BitsAll() & ~BB_SINGLE[mv.From()];
+	U64 bishops = pos.Bits(BW) | pos.Bits(BB) | pos.Bits(QW) | pos.Bits(QB);
+	U64 rooks = pos.Bits(RW) | pos.Bits(RB) | pos.Bits(QW) | pos.Bits(QB);
+	U64 attackers = SEE_Attackers(pos, to, occ, bishops, rooks) & occ;
+
+	EVAL gain[32];
+	EVAL target = SEE_VALUE[mv.Piece()];
+	int d = 0;
+
+	gain[0] = SEE_VALUE[mv.Captured()];
+	while (d < 31)
+	{
+		side ^= 1;
+		U64 x = attackers & pos.BitsAll(side);
+		if (!x)
+			break;
+
+		PIECE piece = SEE_LeastAttacker(pos, x, side);
+
+		++d;
+		gain[d] = target - gain[d - 1];
 
-	return -SEE_Exchange(pos, mv.To(), side ^ 1, -score, target, occ);
+		target = SEE_VALUE[piece];
+		occ ^= BB_SINGLE[LSB(x & pos.Bits(piece))];
+		if (SEE_XRAY_BISHOP[piece])
+			attackers |= BishopAttacks(to, occ) & bishops;
+		if (SEE_XRAY_ROOK[piece])
+			attackers |= RookAttacks(to, occ) & rooks;
+		attackers &= occ;
+	}
+
+	for (; d > 0; --d)
+		gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+
+	return gain[0];
 }
 ////////////////////////////////////////////////////////////////////////////////
 
-EVAL Search::SEE_Exchange(const Position& pos, FLD f, COLOR side, EVAL score, EVAL target, U64 occ)
+bool Search::SEE_GE(const Position& pos, Move mv, EVAL threshold)
 {
-	U64 x;
-	FLD from = NF;
-	EVAL newTarget = 0;
+	EVAL swap = SEE_VALUE[mv.Captured()] - threshold;
+	if (swap < 0)
+		return false;
+
+	swap = SEE_VALUE[mv.Piece()] - swap;
+	if (swap <= 0)
+		return true;
+
+	FLD to = mv.To();
+	COLOR side = GetColor(mv.Piece());
+	U64 occ = pos.BitsAll() & ~BB_SINGLE[mv.From()];
+	U64 bishops = pos.Bits(BW) | pos.Bits(BB) | pos.Bits(QW) | pos.Bits(QB);
+	U64 rooks = pos.Bits(RW) | pos.Bits(RB) | pos.Bits(QW) | pos.Bits(QB);
+	U64 attackers = SEE_Attackers(pos, to, occ, bishops, rooks) & occ;
+	int result = 1;
 
-	// find least attacker
-	do
+	while (1)
 	{
-		// pawns
-		x = BB_PAWN_ATTACKS[f][side ^ 1] & pos.Bits(PAWN | side) & occ;
-		if (x)
-		{
-			from = LSB(x);
-			newTarget = SEE_VALUE[PAWN | side];
+		side ^= 1;
+		U64 x = attackers & pos.BitsAll(side);
+		if (!x)
 			break;
-		}
 
-		// knights
-		x = BB_KNIGHT_ATTACKS[f] & pos.Bits(KNIGHT | side) & occ;
-		if (x)
-		{
-			from = LSB(x);
-			newTarget = SEE_VALUE[KNIGHT | side];
-			break;
-		}
+		PIECE piece = SEE_LeastAttacker(pos, x, side);
 
-		// bishops
-		x = BishopAttacks(f, occ) & pos.Bits(BISHOP | side) & occ;
-		if (x)
-		{
-			from = LSB(x);
-			newTarget = SEE_VALUE[BISHOP | side];
+		result ^= 1;
+		swap = SEE_VALUE[piece] - swap;
+		if (swap < result)
 			break;
-		}
 
-		// rooks
-		x = RookAttacks(f, occ) & pos.Bits(ROOK | side) & occ;
-		if (x)
-		{
-			from = LSB(x);
-			newTarget = SEE_VALUE[ROOK | side];
-			break;
-		}
+		occ ^= BB_SINGLE[LSB(x & pos.Bits(piece))];
+		if (SEE_XRAY_BISHOP[piece])
+			attackers |= BishopAttacks(to, occ) & bishops;
+		if (SEE_XRAY_ROOK[piece])
+			attackers |= RookAttacks(to, occ) & rooks;
+		attackers &= occ;
+	}
 
-		// queens
-		x = QueenAttacks(f, occ) & pos.Bits(QUEEN | side) & occ;
-		if (x)
-		{
-			from = LSB(x);
-			newTarget = SEE_VALUE[QUEEN | side];
-			break;
-		}
+	return result != 0;
+}
+////////////////////////////////////////////////////////////////////////////////
 
-		// kings
-		x = BB_KING_ATTACKS[f] & pos.Bits(KING | side) & occ;
-		if (x)
-		{
-			from = LSB(x);
-			newTarget = SEE_VALUE[KING | side];
-			break;
-		}
+U64 Search::SEE_Attackers(const Position& pos, FLD f, U64 occ, U64 bishops, U64 rooks)
+{
+	return (BB_PAWN_ATTACKS[f][BLACK] & pos.Bits(PW)) |
+		(BB_PAWN_ATTACKS[f][WHITE] & pos.Bits(PB)) |
+		(BB_KNIGHT_ATTACKS[f] & (pos.Bits(NW) | pos.Bits(NB))) |
+		(BishopAttacks(f, occ) & bishops) |
+		(RookAttacks(f, occ) & rooks) |
+		(BB_KING_ATTACKS[f] & (pos.Bits(KW) | pos.Bits(KB)));
+}
+////////////////////////////////////////////////////////////////////////////////
 
-		return score;
-	} while (0);
+PIECE Search::SEE_LeastAttacker(const Position& pos, U64 attackers, COLOR side)
+{
+	assert(attackers != 0);
+
+	PIECE piece = PAWN | side;
+	while (!(attackers & pos.Bits(piece)))
+		piece += 2;
+
+	assert(piece <= (KING | side));
+	return piece;
+}
+////////////////////////////////////////////////////////////////////////////////
 
-	EVAL exchangeScore = -SEE_Exchange(pos, f, side ^ 1,
-		-(score + target), newTarget,
-		occ & ~BB_SINGLE[from]);
+void Search::SendTelemetry(int depth, EVAL score, U64 time)
+{
+	//
+	//   One JSON object per line and completed iteration. The helpers
+	//   are still running, so the ratios come from the main thread's
+	//   counters only
+	//
+
+	const SearchStats& st = s_threads[0]->m_stats;
+	NODES nodes = s_iterNodes.back();
+	NODES mainNodes = s_threads[0]->m_nodes.Get();
+
+	double ebf = 0;
+	size_t n = s_iterNodes.size();
+	if (n >= 3 && s_iterNodes[n - 2] > s_iterNodes[n - 3])
+		ebf = static_cast<double>(s_iterNodes[n - 1] - s_iterNodes[n - 2]) / (s_iterNodes[n - 2] - s_iterNodes[n - 3]);
+
+	fprintf(g_telemetry,
+		"{\"depth\":%d,\"score\":%d,\"time\":%llu,\"nodes\":%llu,\"threads\":%d,\"ebf\":%.3f,"
+		"\"first_move_cutoff\":%.4f,\"null_move_cutoff\":%.4f,\"lmr_research\":%.4f,"
+		"\"futility\":%llu,\"razor\":%llu,\"lmp\":%llu,\"see_quiet\":%llu,\"probcut\":%llu,\"multicut\":%llu,"
+		"\"extensions\":%llu,\"singular\":%llu,\"qsearch_share\":%.4f,\"qsearch_hash_hit\":%.4f}\n",
+		depth, score, (unsigned long long)time, (unsigned long long)nodes, s_numThreads, ebf,
+		Percent(st.firstMoveCutoffs, st.betaCutoffs) / 100,
+		Percent(st.nullMoveCutoffs, st.nullMoveTries) / 100,
+		Percent(st.lmrResearches, st.lmrReductions) / 100,
+		(unsigned long long)st.futilityPrunes,
+		(unsigned long long)st.razorPrunes,
+		(unsigned long long)st.lateMovePrunes,
+		(unsigned long long)st.seeQuietPrunes,
+		(unsigned long long)st.probCuts,
+		(unsigned long long)st.multiCuts,
+		(unsigned long long)st.extensions,
+		(unsigned long long)st.singularExtensions,
+		Percent(st.qNodes, mainNodes) / 100,
+		Percent(st.qHits, st.qProbes) / 100);
+	fflush(g_telemetry);
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void Search::SetHashInterleave(bool on)
+{
+	if (on == s_hashInterleave)
+		return;
 
-	return std::max(score, exchangeScore);
+	s_hashInterleave = on;
+	if (s_hash != NULL)
+		InterleaveMemory(s_hash, s_hashSize * sizeof(HashEntry), on);
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -485,6 +933,9 @@ void Search::SetHashSize(double mb)
 
 	s_hash = new HashEntry[s_hashSize];
 	s_hashMask = s_hashSize - 1;
+
+	if (s_hashInterleave)
+		InterleaveMemory(s_hash, s_hashSize * sizeof(HashEntry), true);
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -509,6 +960,16 @@ void Search::SetStrength(int level)
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+void Search::SetThreadAffinity(bool on)
+{
+	if (on == s_threadAffinity)
+		return;
+
+	s_threadAffinity = on;
+	InitThreads(s_numThreads);
+}
+////////////////////////////////////////////////////////////////////////////////
+
 void Search::StartPerft(Position& pos, int depth)
 {
 	NODES total = 0;
@@ -542,15 +1003,41 @@ void Search::StartPerft(Position& pos, int depth)
 
 void Search::StartSearch(const Position& pos)
 {
-	s_startTime = GetProcTime();
+	s_startTime = GetMonotonicTime();
 	s_pos = pos;
 	++s_hashAge;
 
 	s_results.bestMove = Move(0);
 	s_results.depth = 0;
+	s_results.score = 0;
+	s_results.stopTime = 0;
+	s_iterNodes.clear();
+
+	//
+	//   Under a pure node limit the threads can run in lockstep rounds,
+	//   see DeterministicRelease, so that the result does not depend on
+	//   thread scheduling
+	//
+
+	s_deterministic = s_params.deterministic &&
+		s_params.limitNodes &&
+		!s_params.limitTime &&
+		!s_params.limitKnps &&
+		!s_params.analysis &&
+		s_numThreads > 1;
+
+	if (s_deterministic)
+	{
+		s_shardSize = MIN_SHARD_SIZE;
+		while (2 * s_shardSize <= std::min(s_hashSize / s_numThreads, MAX_SHARD_SIZE))
+			s_shardSize *= 2;
+
+		// helpers prepare their own shards
+		s_threads[0]->PrepareShard(s_shardSize);
+	}
 
 	for (int i = 0; i < s_numThreads; ++i)
-		s_threads[i].NewSearch(pos);
+		s_threads[i]->NewSearch(pos);
 
 	Log("SEARCH: %s", pos.FEN().c_str());
 
@@ -569,123 +1056,338 @@ void Search::StartSearch(const Position& pos)
 	if (legalMoves == 0) return;
 	bool singleReply = (legalMoves == 1);
 
-	for (int i = 0; i < s_numThreads; ++i)
-		s_threads[i].Work();
+	SetSearching(true);
+	ReleaseHelpers(!s_deterministic);
 
-	SearchThread& thread = s_threads[0];
+	// a stop read while no search was running
+	if (InputInterrupted())
+		RequestStop();
+
+	SearchThread& thread = *s_threads[0];
 	s_alpha = -INFINITY_SCORE;
 	s_beta = INFINITY_SCORE;
+	s_instability = 0;
+	EVAL delta = s_params.aspirationDelta;
+
+	Move prevBestMove;
+	EVAL prevScore = 0;
+	U64 iterStartTime = 0;
+	U64 prevIterTime = 0;
+	int startedIter = 0;
 
 	for (s_iter = 1; s_iter < MAX_PLY; ++s_iter)
 	{
-		thread.ClearExcludedMoves();
-		for (int multipv = 0; multipv < s_params.multipv; ++multipv)
+		if (s_iter != startedIter)
 		{
-			s_score = thread.AlphaBeta(s_alpha, s_beta, s_iter, 0);
-			if (thread.Stopped()) break;
+			// re-searches after a window failure belong to the same iteration
+			startedIter = s_iter;
+			iterStartTime = CurrentSearchTime();
+		}
+
+		if (s_deterministic)
+			DeterministicRelease();
+
+		s_score = thread.AlphaBeta(s_alpha, s_beta, s_iter, 0);
+
+		bool lastRound = s_deterministic && !DeterministicBarrier();
 
-			U64 time = CurrentSearchTime();
-			NODES nodes = thread.m_nodes;
+		if (thread.Stopped()) break;
 
-			if (s_params.limitKnps && s_iter > 1)
+		U64 time = CurrentSearchTime();
+		NODES nodes = TotalNodes();
+
+		if (s_params.limitKnps && s_iter > 1)
+		{
+			U64 expectedTime = static_cast<U64>(nodes / s_params.maxKnps);
+			while (time < expectedTime)
 			{
-				U64 expectedTime = static_cast<U64>(nodes / s_params.maxKnps);
-				while (time < expectedTime)
-				{
-					SleepMillisec(10);
-					time = CurrentSearchTime();
+				SleepMillisec(10);
+				time = CurrentSearchTime();
 
-					thread.CheckLimits();
-					thread.CheckInput(true);
-					if (thread.Stopped()) break;
-				}
+				thread.CheckLimits();
+				thread.CheckInput(true);
+				if (thread.Stopped()) break;
 			}
+		}
 
-			if (!s_params.silent)
-				PrintPV(multipv);
-
-			if (s_score > s_alpha && s_score < s_beta)
+		if (!s_params.silent)
+		{
+			if (s_params.multipv == 1)
+				PrintPV(thread, thread.RootPV(), s_iter, s_score, 0);
+			else
 			{
-				const vector<Move>& pv = thread.m_pvs[0];
-				if (!pv.empty())
+				// the root table is sorted, the best lines come first
+				const vector<RootMove>& rootMoves = thread.m_rootMoves;
+				for (int i = 0; i < s_params.multipv && i < (int)rootMoves.size(); ++i)
 				{
-					thread.ExcludeMove(pv[0]);   // for multipv mode
-					s_results.bestMove = pv[0];
-					s_results.depth = s_iter;
+					if (rootMoves[i].m_score > -INFINITY_SCORE)
+						PrintPV(thread, rootMoves[i].m_pv, s_iter, rootMoves[i].m_score, i);
 				}
+			}
+		}
 
-				if (s_params.analysis == false)
-				{
-					if (s_params.limitTime &&
-						time >= s_params.maxTimeSoft)
-					{
-						thread.Stop();
-						Log("Search stopped by stSoft, dt = %d", time);
-						break;
-					}
+		if (s_score > s_alpha && s_score < s_beta)
+		{
+			const vector<Move> pv = thread.RootPV();
+			if (!pv.empty())
+			{
+				s_results.bestMove = pv[0];
+				s_results.depth = s_iter;
+				s_results.score = s_score;
 
-					if (singleReply)
-					{
-						thread.Stop();
-						break;
-					}
+				thread.m_completedDepth = s_iter;
+				thread.m_completedScore = s_score;
+				thread.m_completedPV = pv;
+			}
 
-					if (s_score + s_iter >= CHECKMATE_SCORE)
-					{
-						thread.Stop();
-						break;
-					}
+			s_iterNodes.push_back(nodes);
+			if (g_telemetry != NULL)
+				SendTelemetry(s_iter, s_score, time);
+
+			if (s_params.analysis == false)
+			{
+				if (s_params.limitTime &&
+					s_params.adaptiveTime &&
+					!pv.empty())
+				{
+					U64 iterTime = time - iterStartTime;
+					bool changed = !prevBestMove.IsNull() && !(pv[0] == prevBestMove);
+					EVAL scoreDrop = (s_iter > 1)? prevScore - s_score : 0;
+
+					prevBestMove = pv[0];
+					prevScore = s_score;
 
-					if (s_params.limitDepth &&
-						s_iter >= s_params.maxDepth)
+					bool stop = TimeToStop(time, iterTime, prevIterTime, changed, scoreDrop);
+					prevIterTime = iterTime;
+
+					if (stop)
 					{
 						thread.Stop();
+						Log("Search stopped by time manager, dt = %d", time);
 						break;
 					}
 				}
+				else if (s_params.limitTime &&
+					time >= s_params.maxTimeSoft)
+				{
+					thread.Stop();
+					Log("Search stopped by stSoft, dt = %d", time);
+					break;
+				}
 
-				if (s_params.multipv == 1)
+				if (singleReply)
 				{
-					s_alpha = std::max(s_score - WINDOW_ROOT / 2, -INFINITY_SCORE);
-					s_beta = std::min(s_score + WINDOW_ROOT / 2, INFINITY_SCORE);
+					thread.Stop();
+					break;
 				}
-			}
-			else
-			{
-				s_alpha = -INFINITY_SCORE;
-				s_beta = INFINITY_SCORE;
-				--s_iter;
-			}
 
-			if (g_uci && time > 1000)
-				Out("info time %d nodes %d nps %d hashfull %d\n",
-					(int)time,
-					(int)nodes,
-					(int)(1000 * nodes / time),
-					(int)(1000 * s_hashFull / s_hashSize));
+				if (s_score + s_iter >= CHECKMATE_SCORE)
+				{
+					thread.Stop();
+					break;
+				}
 
-		} // for (int i = 0; i < s_params.multipv; ++i)
-	} // for (int depth = 1; depth < MAX_PLY; ++depth)
+				if (s_params.limitDepth &&
+					s_iter >= s_params.maxDepth)
+				{
+					thread.Stop();
+					break;
+				}
+			}
 
-	if (g_console && !s_params.silent)
-		Out("\n");
+			if (s_params.multipv == 1)
+				thread.AspirationResult(s_score, s_alpha, s_beta, delta);
+		}
+		else
+		{
+			thread.AspirationResult(s_score, s_alpha, s_beta, delta);
+			--s_iter;
+		}
 
-	for (int i = 1; i < s_numThreads; ++i)
-		s_threads[i].Stop();
+		if (g_uci && time > 1000)
+			Out("info time %d nodes %llu nps %llu hashfull %d\n",
+				(int)time,
+				(unsigned long long)nodes,
+				(unsigned long long)(1000 * nodes / time),
+				(int)(1000 * s_hashFull / s_hashSize));
+
+		if (lastRound)
+		{
+			thread.Stop();
+			break;
+		}
+	} // for (int depth = 1; depth < MAX_PLY; ++depth)
 
 	if (s_params.analysis)
 	{
+#ifndef SINGLE_THREAD
+		// the input thread raises the stop flag
+		while (!thread.Stopped())
+			SleepMillisec(10);
+#else
 		while (!thread.Stopped())
 		{
 			string s;
-			getline(cin, s);
+			if (!WaitInput(s))
+				break;
+			Log("> %s\n", s.c_str());
 			thread.ProcessInput(s);
 		}
+#endif
+	}
+
+	// stopped by a command before the first iteration was done
+	if (s_results.bestMove.IsNull() && !thread.m_rootMoves.empty())
+		s_results.bestMove = thread.m_rootMoves[0].m_mv;
+
+	if (InputInterrupted())
+		s_results.stopTime = InterruptTime();
+
+	RequestStop();
+	WaitHelpers();
+	SetSearching(false);
+	s_deterministic = false;
+
+	Log("SEARCH: aspiration fail high = %d, fail low = %d\n", thread.m_failHigh, thread.m_failLow);
+
+	if (s_numThreads > 1 &&
+		s_params.multipv == 1 &&
+		!s_params.analysis &&
+		!s_params.limitDepth &&
+		!s_params.limitKnps)
+	{
+		const SearchThread* best = PickBestThread();
+		if (best != &thread)
+		{
+			Log("SEARCH: thread %d selected, depth = %d\n", best->Id(), best->m_completedDepth);
+			s_results.bestMove = best->m_completedPV[0];
+			s_results.depth = best->m_completedDepth;
+			s_results.score = best->m_completedScore;
+
+			if (!s_params.silent)
+			{
+				// the helper's score is exact, not bounded by the main thread's last window
+				s_alpha = -INFINITY_SCORE;
+				s_beta = INFINITY_SCORE;
+				PrintPV(*best, best->m_completedPV, best->m_completedDepth, best->m_completedScore, 0);
+			}
+		}
 	}
+
+	if (g_debug && !s_params.silent)
+		PrintThreadStats();
+
+	if (g_console && !s_params.silent)
+		Out("\n");
+}
+////////////////////////////////////////////////////////////////////////////////
+
+bool Search::TimeToStop(U64 time, U64 iterTime, U64 prevIterTime, bool bestMoveChanged, EVAL scoreDrop)
+{
+	//
+	//   maxTimeSoft is the share of the clock planned for this move.
+	//   It is stretched while the best move keeps changing or the score
+	//   falls, shrunk when one root move takes nearly all the nodes. An
+	//   iteration is not started when it would likely end far beyond that
+	//   target or after maxTimeHard
+	//
+
+	const SearchThread& thread = *s_threads[0];
+
+	s_instability = s_instability * TM_INSTABILITY_DECAY + (bestMoveChanged? 1 : 0);
+	double factor = 1 + TM_INSTABILITY_WEIGHT * s_instability;
+
+	if (scoreDrop > 0)
+		factor *= 1 + TM_SCORE_DROP_WEIGHT * std::min(scoreDrop, TM_SCORE_DROP_MAX) / TM_SCORE_DROP_MAX;
+
+	factor *= std::max(0.5, std::min(1.2, 1.5 - thread.BestMoveShare()));
+
+	double optimum = std::min(factor * s_params.maxTimeSoft, static_cast<double>(s_params.maxTimeHard));
+	if (time >= optimum)
+		return true;
+
+	double branching = TM_MAX_BRANCHING;
+	if (prevIterTime > 0)
+		branching = std::max(TM_MIN_BRANCHING, std::min(TM_MAX_BRANCHING, static_cast<double>(iterTime) / prevIterTime));
+
+	double predicted = iterTime * branching;
+	if (time + predicted > std::min(TM_MAX_OVERRUN * optimum, static_cast<double>(s_params.maxTimeHard)))
+		return true;
+
+	return false;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+NODES Search::TotalNodes()
+{
+	NODES total = 0;
+	for (int i = 0; i < s_numThreads; ++i)
+		total += s_threads[i]->m_nodes.Get();
+	return total;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void Search::WaitHelpers()
+{
+#ifndef SINGLE_THREAD
+	std::unique_lock<std::mutex> lock(s_poolMutex);
+	s_doneCv.wait(lock, [] { return s_busy == 0; });
+#endif
+}
+////////////////////////////////////////////////////////////////////////////////
+
+bool Search::WaitWork(U32& generation)
+{
+	//
+	//   Called by a helper that has finished its part: checks out of the
+	//   current generation and sleeps until the next one or quit
+	//
+
+#ifndef SINGLE_THREAD
+	std::unique_lock<std::mutex> lock(s_poolMutex);
+	if (--s_busy == 0)
+		s_doneCv.notify_all();
+
+	s_poolCv.wait(lock, [&generation] { return s_quit || s_generation != generation; });
+	generation = s_generation;
+	return !s_quit;
+#else
+	return false;
+#endif
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void SearchStats::Add(const SearchStats& other)
+{
+	betaCutoffs += other.betaCutoffs;
+	firstMoveCutoffs += other.firstMoveCutoffs;
+	nullMoveTries += other.nullMoveTries;
+	nullMoveCutoffs += other.nullMoveCutoffs;
+	lmrReductions += other.lmrReductions;
+	lmrResearches += other.lmrResearches;
+	futilityPrunes += other.futilityPrunes;
+	razorPrunes += other.razorPrunes;
+	lateMovePrunes += other.lateMovePrunes;
+	seeQuietPrunes += other.seeQuietPrunes;
+	probCuts += other.probCuts;
+	multiCuts += other.multiCuts;
+	extensions += other.extensions;
+	singularExtensions += other.singularExtensions;
+	qNodes += other.qNodes;
+	qProbes += other.qProbes;
+	qHits += other.qHits;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+static bool RootMoveBefore(const RootMove& a, const RootMove& b)
+{
+	if (a.m_score != b.m_score)
+		return a.m_score > b.m_score;
+	return a.m_nodes > b.m_nodes;
 }
 ////////////////////////////////////////////////////////////////////////////////
 
-EVAL SearchThread::AlphaBeta(const EVAL alpha, const EVAL beta, const int depth, const int ply)
+EVAL SearchThread::AlphaBeta(EVAL alpha, const EVAL beta, const int depth, const int ply)
 {
 	if (ply > MAX_PLY)
 		return alpha;
@@ -693,7 +1395,7 @@ EVAL SearchThread::AlphaBeta(const EVAL alpha, const EVAL beta, const int depth,
 	m_selDepth = std::max(m_selDepth, depth);
 	m_selDepth = std::max(m_selDepth, ply);
 
-	m_pvs[ply].clear();
+	m_pvLength[ply] = 0;
 
 	CheckLimits();
 	CheckInput();
@@ -706,6 +1408,13 @@ EVAL SearchThread::AlphaBeta(const EVAL alpha, const EVAL beta, const int depth,
 	if (ply > 0 && pos.Repetitions() >= 2)
 		return DRAW_SCORE;
 
+	if (ply > 0 && alpha < DRAW_SCORE && pos.HasUpcomingRepetition(ply))
+	{
+		alpha = DRAW_SCORE;
+		if (alpha >= beta)
+			return alpha;
+	}
+
 	int nodeType = (beta - alpha > 1) ? NODE_PV : NODE_NON_PV;
 	if (USE_MATE_PRUNING[nodeType])
 	{
@@ -717,22 +1426,35 @@ EVAL SearchThread::AlphaBeta(const EVAL alpha, const EVAL beta, const int depth,
 	//   PROBING HASH
 	//
 
+	//
+	//   A singular test search shares the position with its parent node,
+	//   so it must neither take cutoffs from nor store to its hash entry
+	//
+
+	Move excluded = m_excluded[ply];
+
 	Move hashMove;
-	HashEntry* pEntry = Search::ProbeHash(pos);
+	HashEntry* pEntry = ProbeHash(pos);
+	EVAL hashScore = 0;
+	int hashDepth = 0;
+	U8 hashEntryType = HASH_ALPHA;
 
 	if (pEntry != NULL)
 	{
 		hashMove = pEntry->GetMove();
-		if (pEntry->GetDepth() >= depth && ply > 0)
+		hashScore = pEntry->GetScore(ply);
+		hashDepth = pEntry->GetDepth();
+		hashEntryType = pEntry->GetType();
+
+		if (hashDepth >= depth && ply > 0 && excluded.IsNull())
 		{
-			EVAL hashScore = pEntry->GetScore(ply);
-			if (USE_HASH_EXACT_EVAL[nodeType] && pEntry->GetType() == HASH_EXACT)
+			if (USE_HASH_EXACT_EVAL[nodeType] && hashEntryType == HASH_EXACT)
 				return hashScore;
 			if (USE_HASH_PRUNING[nodeType])
 			{
-				if (pEntry->GetType() == HASH_ALPHA && hashScore <= alpha)
+				if (hashEntryType == HASH_ALPHA && hashScore <= alpha)
 					return alpha;
-				if (pEntry->GetType() == HASH_BETA && hashScore >= beta)
+				if (hashEntryType == HASH_BETA && hashScore >= beta)
 					return beta;
 			}
 		}
@@ -740,6 +1462,7 @@ EVAL SearchThread::AlphaBeta(const EVAL alpha, const EVAL beta, const int depth,
 
 	COLOR side = pos.Side();
 	Move lastMove = pos.LastMove();
+	Move prevMove = pos.PrevMove();
 	bool inCheck = pos.InCheck();
 	bool isNull = lastMove.IsNull();
 	Move bestMove;
@@ -757,7 +1480,14 @@ EVAL SearchThread::AlphaBeta(const EVAL alpha, const EVAL beta, const int depth,
 	//   FUTILITY
 	//
 
-	EVAL staticScore = Evaluate(pos);
+	EVAL staticScore = Evaluate(pos, m_pawnHash);
+
+	// the side to move is better off than two plies ago, or either position is in check
+	m_evalStack[ply] = inCheck? -INFINITY_SCORE : staticScore;
+	bool improving = inCheck ||
+		ply < 2 ||
+		m_evalStack[ply - 2] == -INFINITY_SCORE ||
+		staticScore > m_evalStack[ply - 2];
 
 	if (USE_FUTILITY[nodeType] &&
 		!inCheck &&
@@ -765,10 +1495,36 @@ EVAL SearchThread::AlphaBeta(const EVAL alpha, const EVAL beta, const int depth,
 		depth >= 1 &&
 		depth <= 3)
 	{
-		if (staticScore <= alpha - FUTILITY_MARGIN_ALPHA[depth])
-			return AlphaBetaQ(alpha, beta, ply, 0);
 		if (staticScore >= beta + FUTILITY_MARGIN_BETA[depth])
+		{
+			++m_stats.futilityPrunes;
 			return beta;
+		}
+	}
+
+	//
+	//   RAZORING
+	//
+	//   Far below alpha at shallow depth, the quiescence search decides:
+	//   at depth 1 its score is taken as is, deeper it only confirms
+	//   a fail low
+	//
+
+	if (USE_RAZORING[nodeType] &&
+		!inCheck &&
+		!isNull &&
+		excluded.IsNull() &&
+		depth <= RAZOR_MAX_DEPTH &&
+		staticScore + Search::s_params.razorMargin * depth <= alpha)
+	{
+		EVAL qScore = AlphaBetaQ(alpha, beta, ply, 0);
+		if (Stopped())
+			return alpha;
+		if (depth == 1 || qScore <= alpha)
+		{
+			++m_stats.razorPrunes;
+			return qScore;
+		}
 	}
 
 	//
@@ -778,6 +1534,7 @@ EVAL SearchThread::AlphaBeta(const EVAL alpha, const EVAL beta, const int depth,
 	if (USE_NULLMOVE[nodeType] &&
 		!inCheck &&
 		!isNull &&
+		excluded.IsNull() &&
 		pos.MatIndex(side) > 0 &&
 		depth >= NULLMOVE_MIN_DEPTH)
 	{
@@ -786,6 +1543,7 @@ EVAL SearchThread::AlphaBeta(const EVAL alpha, const EVAL beta, const int depth,
 			(depth - NULLMOVE_MIN_DEPTH) / NULLMOVE_DEPTH_DIVISOR +
 			std::max(0, staticScore - beta) / NULLMOVE_EVAL_DIVISOR);
 
+		++m_stats.nullMoveTries;
 		pos.MakeNullMove();
 		EVAL nullScore = -AlphaBeta(-beta, -score, depth - 1 - R, ply + 1);
 		pos.UnmakeNullMove();
@@ -794,26 +1552,133 @@ EVAL SearchThread::AlphaBeta(const EVAL alpha, const EVAL beta, const int depth,
 			return alpha;
 
 		if (nullScore >= beta)
+		{
+			++m_stats.nullMoveCutoffs;
 			return beta;
+		}
+	}
+
+	//
+	//   PROBCUT
+	//
+	//   A capture that holds a margin above beta in a search reduced by
+	//   PROBCUT_REDUCTION plies will almost surely hold beta at full
+	//   depth. Each candidate is tried in the quiescence search first
+	//
+
+	EVAL probBeta = beta + Search::s_params.probCutMargin;
+
+	if (USE_PROBCUT[nodeType] &&
+		!inCheck &&
+		excluded.IsNull() &&
+		depth >= PROBCUT_MIN_DEPTH &&
+		abs(beta) < CHECKMATE_SCORE - 50 &&
+		!(pEntry != NULL &&
+			hashDepth >= depth - PROBCUT_REDUCTION + 1 &&
+			hashEntryType != HASH_BETA &&
+			hashScore < probBeta))
+	{
+		MoveList& captures = m_mvlists[ply];
+		GenCapturesAndPromotions(pos, captures, probBeta - staticScore);
+
+		for (size_t i = 0; i < captures.Size(); ++i)
+		{
+			Move mv = captures[i].m_mv;
+			if (!Search::SEE_GE(pos, mv, probBeta - staticScore))
+				continue;
+
+			if (pos.MakeMove(mv))
+			{
+				m_nodes.Inc();
+
+				EVAL e = -AlphaBetaQ(-probBeta, -probBeta + 1, ply + 1, 0);
+				if (e >= probBeta)
+					e = -AlphaBeta(-probBeta, -probBeta + 1, depth - PROBCUT_REDUCTION, ply + 1);
+
+				pos.UnmakeMove();
+
+				if (Stopped())
+					return alpha;
+
+				if (e >= probBeta)
+				{
+					RecordHash(pos, mv, e, depth - PROBCUT_REDUCTION + 1, ply, HASH_BETA);
+					++m_stats.probCuts;
+					return beta;
+				}
+			}
+		}
 	}
 
 	//
 	//   IID
 	//
 
-	if (USE_IID[nodeType] && hashMove.IsNull() && depth > 4)
+	if (USE_IID[nodeType] && hashMove.IsNull() && depth > 4 && ply > 0)
 	{
 		AlphaBeta(alpha, beta, depth - 4, ply);
-		if (!m_pvs[ply].empty())
-			hashMove = m_pvs[ply][0];
+		if (m_pvLength[ply] > 0)
+			hashMove = m_pv[ply][0];
+	}
+
+	//
+	//   SINGULAR EXTENSION
+	//
+	//   The hash move is singular when every other move fails low against
+	//   a bound a little below its hash score in a reduced search. If even
+	//   that bound is at or above beta, several moves refute the parent
+	//   and the node is cut at once (multi-cut)
+	//
+
+	bool singularExtension = false;
+	if (USE_SINGULAR_EXTENSIONS[nodeType] &&
+		ply > 0 &&
+		excluded.IsNull() &&
+		!hashMove.IsNull() &&
+		depth >= SINGULAR_MIN_DEPTH &&
+		hashDepth >= depth - SINGULAR_HASH_DEPTH_MARGIN &&
+		hashEntryType != HASH_ALPHA &&
+		abs(hashScore) < CHECKMATE_SCORE - 50)
+	{
+		EVAL singularBeta = hashScore - SINGULAR_MARGIN_PER_PLY * depth;
+
+		m_excluded[ply] = hashMove;
+		EVAL e = AlphaBeta(singularBeta - 1, singularBeta, (depth - 1) / 2, ply);
+		m_excluded[ply] = Move();
+		m_pvLength[ply] = 0;
+
+		if (Stopped())
+			return alpha;
+
+		if (e < singularBeta)
+			singularExtension = true;
+		else if (singularBeta >= beta)
+		{
+			++m_stats.multiCuts;
+			return beta;
+		}
 	}
 
 	MoveList& mvlist = m_mvlists[ply];
-	if (inCheck)
-		GenMovesInCheck(pos, mvlist);
+	if (ply == 0)
+	{
+		// root moves come from the table, in the order of the last search
+		mvlist.Clear();
+		for (size_t j = 0; j < m_rootMoves.size(); ++j)
+		{
+			mvlist.Add(m_rootMoves[j].m_mv);
+			mvlist[j].m_score = static_cast<int>(m_rootMoves.size() - j);
+			m_rootMoves[j].m_score = -INFINITY_SCORE;
+		}
+	}
 	else
-		GenAllMoves(pos, mvlist);
-	UpdateSortScores(mvlist, hashMove, ply, lastMove);
+	{
+		if (inCheck)
+			GenMovesInCheck(pos, mvlist);
+		else
+			GenAllMoves(pos, mvlist);
+		UpdateSortScores(mvlist, hashMove, ply, lastMove, prevMove);
+	}
 
 	bool singleReply = false;
 	if (USE_SINGLE_REPLY_EXTENSIONS[nodeType])
@@ -834,34 +1699,56 @@ EVAL SearchThread::AlphaBeta(const EVAL alpha, const EVAL beta, const int depth,
 
 	int legalMoves = 0;
 	int quietMoves = 0;
-	int deltaHist = 1;
+	Move quietsTried[MAX_QUIETS_TRIED];
+	int numQuietsTried = 0;
+	Move capturesTried[MAX_CAPTURES_TRIED];
+	int numCapturesTried = 0;
 
 	for (size_t i = 0; i < mvlist.Size(); ++i)
 	{
 		Move mv = GetNextBest(mvlist, i);
+		if (mv == excluded)
+			continue;
+
+		//
+		//   Late quiet moves at shallow depth are skipped when they come
+		//   after the first few, or lose material by SEE, and give no check
+		//
 
-		bool exclude = false;
-		if (ply == 0)
+		bool quiet = !mv.Captured() && !mv.Promotion();
+		bool mayPrune = ply > 0 &&
+			quiet &&
+			!inCheck &&
+			legalMoves > 0 &&
+			score > -CHECKMATE_SCORE + 50;
+
+		bool lateMove = USE_LMP[nodeType] &&
+			mayPrune &&
+			depth <= LMP_MAX_DEPTH &&
+			legalMoves >= (3 + depth * depth) / (improving? 1 : 2);
+
+		bool losingQuiet = USE_SEE_QUIET_PRUNING[nodeType] &&
+			mayPrune &&
+			!lateMove &&
+			depth <= SEE_QUIET_MAX_DEPTH &&
+			!Search::SEE_GE(pos, mv, -SEE_QUIET_MARGIN_PER_PLY * depth);
+
+		if (pos.MakeMove(mv))
 		{
-			for (size_t j = 0; j < m_exclude.size(); ++j)
+			if ((lateMove || losingQuiet) && !pos.InCheck())
 			{
-				if (mv == m_exclude[j])
-				{
-					exclude = true;
-					break;
-				}
+				pos.UnmakeMove();
+				if (lateMove)
+					++m_stats.lateMovePrunes;
+				else
+					++m_stats.seeQuietPrunes;
+				continue;
 			}
-		}
-		if (exclude)
-			continue;
 
-		if (pos.MakeMove(mv))
-		{
-			++m_nodes;
+			NODES nodesBefore = m_nodes.Get();
+			m_nodes.Inc();
 			++legalMoves;
 
-			m_histTry[mv.To()][mv.Piece()] += deltaHist;
-
 			if (m_id == 0 && ply == 0 && g_uci && Search::CurrentSearchTime() > 1000)
 				Out("info currmove %s currmovenumber %d\n", MoveToStrLong(mv).c_str(), legalMoves);
 
@@ -897,8 +1784,17 @@ EVAL SearchThread::AlphaBeta(const EVAL alpha, const EVAL beta, const int depth,
 					if (singleReply)
 						++newDepth;
 				}
+
+				if (singularExtension && mv == hashMove && !inCheck)
+				{
+					++newDepth;
+					++m_stats.singularExtensions;
+				}
 			}
 
+			if (newDepth >= depth)
+				++m_stats.extensions;
+
 			//
 			//   LMR
 			//
@@ -910,8 +1806,7 @@ EVAL SearchThread::AlphaBeta(const EVAL alpha, const EVAL beta, const int depth,
 				!inCheck &&
 				!pos.InCheck() &&
 				!mv.Captured() &&
-				!mv.Promotion() &&
-				SuccessRate(mv) <= LMR_MAX_SUCCESS_RATE)
+				!mv.Promotion())
 			{
 				++quietMoves;
 				if (quietMoves >= LMR_MIN_MOVE)
@@ -920,19 +1815,44 @@ EVAL SearchThread::AlphaBeta(const EVAL alpha, const EVAL beta, const int depth,
 						1 +
 						(depth - LMR_MIN_DEPTH) / LMR_DEPTH_DIVISOR +
 						(quietMoves - LMR_MIN_MOVE) / LMR_MOVE_DIVISOR);
+
+					// quiet moves with a good record are reduced less, or not at all
+					int adjust = HistoryScore(mv, lastMove, prevMove) / LMR_HISTORY_DIVISOR;
+					adjust = std::max(-LMR_HISTORY_MAX_ADJUST, std::min(adjust, LMR_HISTORY_MAX_ADJUST));
+					reduction -= adjust;
+					reduction = std::max(0, reduction);
 				}
 			}
 
+			//
+			//   With MultiPV the first moves at the root get an open window,
+			//   the rest are tested against the worst of the best lines
+			//
+
+			EVAL bound = score;
+			bool fullWindow = (legalMoves == 1);
+			if (ply == 0 && m_multiPV > 1)
+			{
+				bound = RootBound(i, alpha);
+				fullWindow = (legalMoves <= m_multiPV);
+			}
+
 			EVAL e;
-			if (legalMoves == 1)
-				e = -AlphaBeta(-beta, -score, newDepth, ply + 1);
+			if (fullWindow)
+				e = -AlphaBeta(-beta, -bound, newDepth, ply + 1);
 			else
 			{
-				e = -AlphaBeta(-score - 1, -score, newDepth - reduction, ply + 1);
-				if (e > score && reduction > 0)
-					e = -AlphaBeta(-score - 1, -score, newDepth, ply + 1);
-				if (e > score && e < beta)
-					e = -AlphaBeta(-beta, -score, newDepth, ply + 1);
+				if (reduction > 0)
+					++m_stats.lmrReductions;
+
+				e = -AlphaBeta(-bound - 1, -bound, newDepth - reduction, ply + 1);
+				if (e > bound && reduction > 0)
+				{
+					++m_stats.lmrResearches;
+					e = -AlphaBeta(-bound - 1, -bound, newDepth, ply + 1);
+				}
+				if (e > bound && e < beta)
+					e = -AlphaBeta(-beta, -bound, newDepth, ply + 1);
 			}
 
 			pos.UnmakeMove();
@@ -940,8 +1860,22 @@ EVAL SearchThread::AlphaBeta(const EVAL alpha, const EVAL beta, const int depth,
 			if (Stopped())
 				return alpha;
 
-			if (ply == 0 && legalMoves == 1)
-				UpdatePV(mv, ply);
+			if (ply == 0)
+			{
+				RootMove& rm = m_rootMoves[i];
+				rm.m_nodes = m_nodes.Get() - nodesBefore;
+
+				if (e > bound)
+				{
+					rm.m_score = e;
+					rm.m_depth = depth;
+					rm.m_pv.assign(1, mv);
+					rm.m_pv.insert(rm.m_pv.end(), m_pv[1], m_pv[1] + m_pvLength[1]);
+				}
+
+				if (legalMoves == 1)
+					UpdatePV(mv, ply);
+			}
 
 			if (e > score)
 			{
@@ -960,15 +1894,43 @@ EVAL SearchThread::AlphaBeta(const EVAL alpha, const EVAL beta, const int depth,
 					else
 						m_killers[ply] = mv;
 
-					m_refutations[ply][lastMove.To()][lastMove.Piece()] = mv;
-					m_histSuccess[mv.To()][mv.Piece()] += deltaHist;
+					UpdateHistory(mv, quietsTried, numQuietsTried, depth, lastMove, prevMove);
+					UpdateCaptureHistory(Move(), capturesTried, numCapturesTried, depth);
 				}
+				else
+					UpdateCaptureHistory(mv, capturesTried, numCapturesTried, depth);
+
+				++m_stats.betaCutoffs;
+				if (legalMoves == 1)
+					++m_stats.firstMoveCutoffs;
+
 				hashType = HASH_BETA;
 				break;
 			}
+
+			if (quiet)
+			{
+				if (numQuietsTried < MAX_QUIETS_TRIED)
+					quietsTried[numQuietsTried++] = mv;
+			}
+			else if (numCapturesTried < MAX_CAPTURES_TRIED)
+				capturesTried[numCapturesTried++] = mv;
 		}
 	}
 
+	if (ply == 0)
+	{
+		// moves that failed low keep no score, the larger subtree
+		// is more likely to hold the next best move
+		std::stable_sort(m_rootMoves.begin(), m_rootMoves.end(), RootMoveBefore);
+	}
+
+	if (!excluded.IsNull())
+	{
+		// the excluded move may be the only legal one
+		return score;
+	}
+
 	if (legalMoves == 0)
 	{
 		if (inCheck)
@@ -983,18 +1945,52 @@ EVAL SearchThread::AlphaBeta(const EVAL alpha, const EVAL beta, const int depth,
 	}
 
 	if (!Stopped())
-		Search::RecordHash(pos, bestMove, score, depth, ply, hashType);
+		RecordHash(pos, bestMove, score, depth, ply, hashType);
 
 	return score;
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+bool SearchThread::AspirationResult(EVAL score, EVAL& alpha, EVAL& beta, EVAL& delta)
+{
+	//
+	//   Sets the window for the next root search. Inside the window: a new
+	//   narrow window around the score. Outside: only the failing bound is
+	//   moved, by a delta that grows after every failure
+	//
+
+	if (score > alpha && score < beta)
+	{
+		delta = Search::s_params.aspirationDelta;
+		alpha = std::max(score - delta, -INFINITY_SCORE);
+		beta = std::min(score + delta, INFINITY_SCORE);
+		return true;
+	}
+
+	if (score <= alpha)
+	{
+		++m_failLow;
+		alpha = std::max(score - delta, -INFINITY_SCORE);
+	}
+	else
+	{
+		++m_failHigh;
+		beta = std::min(score + delta, INFINITY_SCORE);
+	}
+
+	// at least 1 cp, so that small deltas grow despite the rounding
+	delta = std::max(delta + 1, delta * Search::s_params.aspirationGrowth / 100);
+	delta = std::min(delta, INFINITY_SCORE);
+	return false;
+}
+////////////////////////////////////////////////////////////////////////////////
+
 EVAL SearchThread::AlphaBetaQ(const EVAL alpha, const EVAL beta, const int ply, const int qply)
 {
 	if (ply > MAX_PLY)
 		return alpha;
 
-	m_pvs[ply].clear();
+	m_pvLength[ply] = 0;
 
 	m_selDepth = std::max(m_selDepth, ply);
 
@@ -1007,15 +2003,45 @@ EVAL SearchThread::AlphaBetaQ(const EVAL alpha, const EVAL beta, const int ply,
 	Position& pos = m_pos;
 
 	int nodeType = (beta - alpha > 1) ? NODE_PV : NODE_NON_PV;
+	int hashDepth = (qply < USE_QCHECKS[nodeType])? HASH_DEPTH_QCHECKS : HASH_DEPTH_QS;
+
+	Move hashMove;
+	HashEntry* pEntry = ProbeHash(pos);
+	++m_stats.qProbes;
+
+	if (pEntry != NULL)
+	{
+		++m_stats.qHits;
+		hashMove = pEntry->GetMove();
+		if (pEntry->GetDepth() >= hashDepth)
+		{
+			EVAL hashScore = pEntry->GetScore(ply);
+			if (USE_HASH_EXACT_EVAL[nodeType] && pEntry->GetType() == HASH_EXACT)
+				return hashScore;
+			if (USE_HASH_PRUNING[nodeType])
+			{
+				if (pEntry->GetType() == HASH_ALPHA && hashScore <= alpha)
+					return alpha;
+				if (pEntry->GetType() == HASH_BETA && hashScore >= beta)
+					return beta;
+			}
+		}
+	}
+
 	bool inCheck = pos.InCheck();
 	Move lastMove = pos.LastMove();
+	Move bestMove;
 	EVAL score = alpha;
-	EVAL staticScore = Evaluate(pos, alpha, beta);
+	U8 hashType = HASH_ALPHA;
+	EVAL staticScore = Evaluate(pos, m_pawnHash, alpha, beta);
 
 	if (!inCheck)
 	{
 		if (staticScore > alpha)
+		{
 			score = staticScore;
+			hashType = HASH_EXACT;
+		}
 		if (score >= beta)
 			return beta;
 	}
@@ -1029,7 +2055,7 @@ EVAL SearchThread::AlphaBetaQ(const EVAL alpha, const EVAL beta, const int ply,
 		if (qply < USE_QCHECKS[nodeType])
 			AddSimpleChecks(pos, mvlist);
 	}
-	UpdateSortScores(mvlist, Move(0), ply, lastMove);
+	UpdateSortScores(mvlist, hashMove, ply, lastMove, pos.PrevMove());
 
 	int legalMoves = 0;
 	for (size_t i = 0; i < mvlist.Size(); ++i)
@@ -1040,13 +2066,20 @@ EVAL SearchThread::AlphaBetaQ(const EVAL alpha, const EVAL beta, const int ply,
 			!inCheck &&
 			qply >= SEE_PRUNING_MIN_QPLY)
 		{
-			if (Search::SEE(pos, mv) < 0)
+			// captures were already classified by SEE when sorted
+			if (mv.Captured() || mv.Promotion())
+			{
+				if (mvlist[i].m_score < SORT_CAPTURE)
+					continue;
+			}
+			else if (!Search::SEE_GE(pos, mv, 0))
 				continue;
 		}
 
 		if (pos.MakeMove(mv))
 		{
-			++m_nodes;
+			m_nodes.Inc();
+			++m_stats.qNodes;
 			++legalMoves;
 
 			EVAL e = -AlphaBetaQ(-beta, -score, ply + 1, qply + 1);
@@ -1058,59 +2091,122 @@ EVAL SearchThread::AlphaBetaQ(const EVAL alpha, const EVAL beta, const int ply,
 			if (e > score)
 			{
 				score = e;
+				bestMove = mv;
 				UpdatePV(mv, ply);
+				hashType = HASH_EXACT;
 			}
 			if (score >= beta)
+			{
+				hashType = HASH_BETA;
 				break;
+			}
 		}
 	}
 
 	if (legalMoves == 0)
 	{
 		if (inCheck)
+		{
 			score = -CHECKMATE_SCORE + ply;
+			hashType = (score >= beta)? HASH_BETA : (score > alpha)? HASH_EXACT : HASH_ALPHA;
+		}
 	}
 
+	RecordHash(pos, bestMove, score, hashDepth, ply, hashType);
 	return score;
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+double SearchThread::BestMoveShare() const
+{
+	//
+	//   Part of the last root search spent below the best move,
+	//   the moves are sorted best first after each iteration
+	//
+
+	NODES total = 0;
+	for (size_t i = 0; i < m_rootMoves.size(); ++i)
+		total += m_rootMoves[i].m_nodes;
+
+	if (total == 0)
+		return 0;
+	return static_cast<double>(m_rootMoves[0].m_nodes) / total;
+}
+////////////////////////////////////////////////////////////////////////////////
+
 void SearchThread::CheckInput(bool force)
 {
+	//
+	//   Without the input thread the search reads the commands itself,
+	//   and each look is a system call. With it, commands that stop the
+	//   search raise the stop flag as they arrive and the rest wait for
+	//   the command loop
+	//
+
+#ifdef SINGLE_THREAD
 	if (m_id != 0 || Stopped() || Search::s_results.depth < 1)
 		return;
 
-	if (force || (m_nodes % 8192 == 0))
+	if (!force && m_nodes.Get() % INPUT_CHECK_INTERVAL != 0)
+		return;
+
+	string s;
+	while (!Stopped() && PollInput(s))
 	{
-		if (InputAvailable())
-		{
-			string s;
-			getline(cin, s);
-			Log("> %s\n", s.c_str());
-			ProcessInput(s);
-		}
+		Log("> %s\n", s.c_str());
+		ProcessInput(s);
 	}
+#else
+	(void)force;
+#endif
 }
 ////////////////////////////////////////////////////////////////////////////////
 
 void SearchThread::CheckLimits()
 {
+	if (Search::s_deterministic)
+	{
+		// every thread watches its own budget, never the clock
+		if (!m_outOfNodes && Search::s_results.depth >= 1 && m_nodes.Get() >= m_nodeLimit)
+			m_outOfNodes = true;
+		return;
+	}
+
 	if (m_id != 0 || Stopped() || Search::s_results.depth < 1)
 		return;
 
 	if (Search::s_params.analysis == false)
 	{
-		if (Search::s_params.limitTime)
+		if (Search::s_params.limitTime &&
+			m_nodes.Get() >= m_nextTimeCheck)
 		{
-			if (Search::CurrentSearchTime() >= Search::s_params.maxTimeHard)
+			U64 time = Search::CurrentSearchTime();
+			if (time >= Search::s_params.maxTimeHard)
 			{
 				Stop();
-				Log("Search stopped by stHard, dt = %d", Search::CurrentSearchTime());
+				Log("Search stopped by stHard, dt = %d", time);
+			}
+			else
+			{
+				//
+				//   Read the clock again after about TIME_CHECK_PERIOD ms
+				//   at the speed measured so far
+				//
+
+				NODES nodes = m_nodes.Get();
+				NODES interval = TIME_CHECK_MIN_NODES;
+				if (time > 0)
+					interval = nodes * TIME_CHECK_PERIOD / static_cast<NODES>(time);
+				interval = std::max(interval, TIME_CHECK_MIN_NODES);
+				interval = std::min(interval, TIME_CHECK_MAX_NODES);
+				m_nextTimeCheck = nodes + interval;
 			}
 		}
 
+		// other threads' counters sit on their own cache lines, so sum them sparingly
 		if (Search::s_params.limitNodes &&
-			m_nodes >= Search::s_params.maxNodes)
+			(Search::s_numThreads == 1 || m_nodes.Get() % NODES_SUM_INTERVAL == 0) &&
+			Search::TotalNodes() >= Search::s_params.maxNodes)
 		{
 			Stop();
 		}
@@ -1120,16 +2216,50 @@ void SearchThread::CheckLimits()
 
 void SearchThread::ClearHistory()
 {
-	memset(m_histTry, 0, 64 * 14 * sizeof(int));
-	memset(m_histSuccess, 0, 64 * 14 * sizeof(int));
+	memset(m_history, 0, sizeof(m_history));
+	memset(m_contHistory, 0, sizeof(m_contHistory));
+	memset(m_captureHistory, 0, sizeof(m_captureHistory));
+	memset((void*)m_counterMoves, 0, sizeof(m_counterMoves));
 }
 ////////////////////////////////////////////////////////////////////////////////
 
-void SearchThread::ClearKillersAndRefutations()
+void SearchThread::ClearKillers()
 {
 	memset((void*)m_killers, 0, (MAX_PLY + 1) * sizeof(Move));
 	memset((void*)m_mateKillers, 0, (MAX_PLY + 1) * sizeof(Move));
-	memset((void*)m_refutations, 0, (MAX_PLY + 1) * 64 * 14 * sizeof(Move));
+	memset((void*)m_excluded, 0, (MAX_PLY + 1) * sizeof(Move));
+}
+////////////////////////////////////////////////////////////////////////////////
+
+EVAL SearchThread::RootBound(size_t searched, EVAL alpha) const
+{
+	//
+	//   Lowest score among the m_multiPV best of the first root moves,
+	//   alpha while fewer of them have been found
+	//
+
+	EVAL best[MAX_MULTIPV];
+	int count = 0;
+
+	for (size_t j = 0; j < searched; ++j)
+	{
+		EVAL e = m_rootMoves[j].m_score;
+		if (e <= alpha)
+			continue;
+
+		int k = std::min(count, m_multiPV - 1);
+		if (count == m_multiPV && e <= best[k])
+			continue;
+		while (k > 0 && best[k - 1] < e)
+		{
+			best[k] = best[k - 1];
+			--k;
+		}
+		best[k] = e;
+		count = std::min(count + 1, m_multiPV);
+	}
+
+	return (count < m_multiPV)? alpha : best[m_multiPV - 1];
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -1144,56 +2274,85 @@ Move SearchThread::GetNextBest(MoveList& mvlist, size_t i)
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+int SearchThread::HistoryScore(Move mv, Move lastMove, Move prevMove) const
+{
+	int score = m_history[GetColor(mv.Piece())][mv.From()][mv.To()];
+	if (!lastMove.IsNull())
+		score += m_contHistory[lastMove.Piece()][lastMove.To()][mv.Piece()][mv.To()];
+	if (!prevMove.IsNull())
+		score += m_contHistory[prevMove.Piece()][prevMove.To()][mv.Piece()][mv.To()];
+	return score;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void SearchThread::HelperMain(int id)
+{
+#ifndef SINGLE_THREAD
+	Log("Thread %d started\n", id);
+
+	if (Search::ThreadAffinity() && BindThreadToCPU(id))
+		Log("Thread %d is bound to its CPU\n", id);
+
+	// first touch: the pages of the big tables now belong to this thread's node
+	SearchThread* thread = new SearchThread;
+	thread->m_id = id;
+	thread->ClearKillers();
+	thread->ClearHistory();
+
+	// InitThreads reads the slot only after this helper has checked in
+	Search::s_threads[id] = thread;
+
+	thread->HelperProc();
+#endif
+}
+////////////////////////////////////////////////////////////////////////////////
+
 void SearchThread::HelperProc()
 {
 #ifndef SINGLE_THREAD
-	Log("Thread %d started\n", m_id);
+	U32 generation = Search::s_generation;
 
-	while (m_state != THREAD_QUIT)
+	while (Search::WaitWork(generation))
 	{
+		if (Search::s_deterministic)
 		{
-			std::unique_lock<std::mutex> lock(m_stateMutex);
-			m_state = THREAD_SLEEP;
-			Log("Thread %d is sleeping\n", m_id);
-			m_cv.wait(lock, [this] { return m_state != THREAD_SLEEP; });
-			Log("Thread %d is awaken, m_state = %d\n", m_id, m_state);
+			PrepareShard(Search::s_shardSize);
+			SearchStep();
+			continue;
 		}
 
-		if (m_state == THREAD_WORK)
-		{
-			int startDepth = 1 + m_id;
-			Log("Thread %d is working from depth = %d\n", m_id, startDepth);
+		int skip = (m_id - 1) % HELPER_SKIP_CYCLE;
+		Log("Thread %d is working with skip size = %d, phase = %d\n", m_id, HELPER_SKIP_SIZE[skip], HELPER_SKIP_PHASE[skip]);
 
-			EVAL alpha = -INFINITY_SCORE;
-			EVAL beta = INFINITY_SCORE;
-			int depth = 0;
+		EVAL alpha = -INFINITY_SCORE;
+		EVAL beta = INFINITY_SCORE;
+		EVAL delta = Search::s_params.aspirationDelta;
+		int depth = 0;
 
-			for (depth = startDepth; depth < MAX_PLY; ++depth)
-			{
-				std::lock_guard<std::mutex> lock(m_posMutex);
+		for (depth = 1; depth < MAX_PLY; ++depth)
+		{
+			if (((depth + HELPER_SKIP_PHASE[skip]) / HELPER_SKIP_SIZE[skip]) % 2)
+				continue;
 
-				EVAL e = AlphaBeta(alpha, beta, depth, 0);
+			EVAL e = AlphaBeta(alpha, beta, depth, 0);
 
-				if (m_state != THREAD_WORK)
-					break;
+			if (Stopped())
+				break;
 
-				if (e > alpha && e < beta)
-				{
-					alpha = std::max(e - WINDOW_ROOT / 2, -INFINITY_SCORE);
-					beta = std::min(e + WINDOW_ROOT / 2, INFINITY_SCORE);
-				}
-				else
+			if (e > alpha && e < beta)
+			{
+				if (m_pvLength[0] > 0)
 				{
-					alpha = -INFINITY_SCORE;
-					beta = INFINITY_SCORE;
-					--depth;
+					m_completedDepth = depth;
+					m_completedScore = e;
+					m_completedPV = RootPV();
 				}
 			}
-			Log("Thread %d finished loop; depth = %d, m_state = %d\n",
-				m_id,
-				depth,
-				m_state);
+
+			if (!AspirationResult(e, alpha, beta, delta))
+				--depth;
 		}
+		Log("Thread %d finished loop; depth = %d\n", m_id, depth);
 	}
 
 	Log("Thread %d is quitting\n", m_id);
@@ -1201,33 +2360,104 @@ void SearchThread::HelperProc()
 }
 ////////////////////////////////////////////////////////////////////////////////
 
-void SearchThread::Init(int id)
+void SearchThread::MergeShard()
 {
-	Log("Init(%d) called\n", id);
-	if (m_state != THREAD_NEW)
-		return;
-	m_id = id;
-#ifndef SINGLE_THREAD
-	m_thread = std::thread(std::bind(&SearchThread::HelperProc, this));
-#endif
+	for (size_t i = 0; i < m_shardUsed.size(); ++i)
+	{
+		ShardEntry& se = m_hashShard[m_shardUsed[i]];
+		Search::MergeHash(se.m_hash, se.m_entry);
+		se = ShardEntry();
+	}
+	m_shardUsed.clear();
 }
 ////////////////////////////////////////////////////////////////////////////////
 
 void SearchThread::NewSearch(const Position& pos)
 {
-#ifndef SINGLE_THREAD
-	std::lock_guard<std::mutex> lock(m_posMutex);
-#endif
-
-	ClearKillersAndRefutations();
-	ClearHistory();
-	m_nodes = 0;
+	ClearKillers();
+	m_nodes.Reset();
+	m_failHigh = 0;
+	m_failLow = 0;
+	m_stats.Clear();
+	m_nextTimeCheck = 0;
 	m_pos = pos;
 	m_selDepth = 0;
-	m_state = THREAD_WORK;
+	memset(m_pvLength, 0, sizeof(m_pvLength));
+	m_completedDepth = 0;
+	m_completedScore = 0;
+	m_completedPV.clear();
+
+	MoveList& mvlist = m_mvlists[0];
+	GenAllMoves(m_pos, mvlist);
+	HashEntry* pEntry = Search::ProbeHash(m_pos);
+	Move hashMove = pEntry? pEntry->GetMove() : Move();
+	UpdateSortScores(mvlist, hashMove, 0, m_pos.LastMove(), m_pos.PrevMove());
+
+	m_rootMoves.clear();
+	for (size_t i = 0; i < mvlist.Size(); ++i)
+	{
+		Move mv = GetNextBest(mvlist, i);
+		if (m_pos.MakeMove(mv))
+		{
+			m_pos.UnmakeMove();
+			m_rootMoves.push_back(RootMove(mv));
+		}
+	}
+
+	m_multiPV = (m_id == 0)? std::min(std::max(1, Search::s_params.multipv), MAX_MULTIPV) : 1;
+
+	m_nodeLimit = 0;
+	m_outOfNodes = false;
+	m_stepDepth = 1;
+	m_stepAlpha = -INFINITY_SCORE;
+	m_stepBeta = INFINITY_SCORE;
+	m_stepDelta = Search::s_params.aspirationDelta;
+
+	if (Search::s_deterministic && m_id > 0 && !m_rootMoves.empty())
+	{
+		//
+		//   Helpers in lockstep search the main thread's depth, never
+		//   deeper, so that their exact entries do not cut its PV short.
+		//   A different first root move keeps them from repeating it
+		//
+
+		size_t first = m_id % m_rootMoves.size();
+		std::rotate(m_rootMoves.begin(), m_rootMoves.begin() + first, m_rootMoves.end());
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void SearchThread::PrepareShard(size_t size)
+{
+	if (m_hashShard.size() != size)
+	{
+		m_hashShard.assign(size, ShardEntry());
+		m_shardMask = size - 1;
+	}
+	m_shardUsed.clear();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+HashEntry* SearchThread::ProbeHash(const Position& pos)
+{
+	//
+	//   In deterministic rounds the shared table is read-only, this
+	//   thread's own writes are found in its shard
+	//
+
+	if (Search::s_deterministic)
+	{
+		U64 hash = pos.Hash();
+		ShardEntry& se = m_hashShard[hash & m_shardMask];
+		if (se.m_hash == hash && !se.m_entry.IsEmpty())
+			return &se.m_entry;
+	}
+
+	return Search::ProbeHash(pos);
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+#ifdef SINGLE_THREAD
 void SearchThread::ProcessInput(const string& s)
 {
 	if (m_id != 0)
@@ -1266,7 +2496,7 @@ void SearchThread::ProcessInput(const string& s)
 			Stop();
 		else if (Is(cmd, "result", 1))
 		{
-			m_pvs[0].clear();
+			m_pvLength[0] = 0;
 			Stop();
 		}
 	}
@@ -1283,48 +2513,135 @@ void SearchThread::ProcessInput(const string& s)
 		exit(0);
 	}
 	else if (Is(cmd, "stop", 1))
+	{
+		Search::s_results.stopTime = LastInputTime();
 		Stop();
+	}
 }
+#endif
 ////////////////////////////////////////////////////////////////////////////////
 
-void SearchThread::Quit()
+void SearchThread::RecordHash(const Position& pos, Move mv, EVAL score, int depth, int ply, U8 hashType)
 {
-#ifndef SINGLE_THREAD
-	Log("Quit(%d) called\n", m_id);
+	if (!Search::s_deterministic)
+	{
+		Search::RecordHash(pos, mv, score, depth, ply, hashType);
+		return;
+	}
+
+	U64 hash = pos.Hash();
+	U32 index = static_cast<U32>(hash & m_shardMask);
+	ShardEntry& se = m_hashShard[index];
+
+	if (Search::KeepHashEntry(se.m_entry, depth))
+		return;
 
+	if (se.m_entry.IsEmpty())
+		m_shardUsed.push_back(index);
+
+	Search::RecordHash(se.m_entry, hash, mv, score, depth, ply, hashType);
+	se.m_hash = hash;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void SearchThread::SearchStep()
+{
+	//
+	//   One root search of a helper between two deterministic barriers:
+	//   the next iteration, or a re-search after the window failed
+	//
+
+	if (m_stepDepth >= MAX_PLY)
+		return;
+
+	EVAL e = AlphaBeta(m_stepAlpha, m_stepBeta, m_stepDepth, 0);
+	if (Stopped())
+		return;
+
+	if (e > m_stepAlpha && e < m_stepBeta && m_pvLength[0] > 0)
 	{
-		std::lock_guard<std::mutex> lock(m_stateMutex);
-		m_state = THREAD_QUIT;
-		m_cv.notify_one();
+		m_completedDepth = m_stepDepth;
+		m_completedScore = e;
+		m_completedPV = RootPV();
 	}
 
-	m_thread.join();
-	m_state = THREAD_NEW;   // for future restart
-#endif
+	if (AspirationResult(e, m_stepAlpha, m_stepBeta, m_stepDelta))
+		++m_stepDepth;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void SearchThread::SetNodeBudget(NODES budget)
+{
+	m_nodeLimit = m_nodes.Get() + budget;
+	m_outOfNodes = false;
 }
 ////////////////////////////////////////////////////////////////////////////////
 
 void SearchThread::Stop()
 {
 	Log("Stop(%d) called\n", m_id);
-#ifndef SINGLE_THREAD
-	std::lock_guard<std::mutex> lock(m_stateMutex);
-	m_state = THREAD_SLEEP;
-	m_cv.notify_one();
-#else
-	m_state = THREAD_SLEEP;
-#endif
+	Search::RequestStop();
 }
 ////////////////////////////////////////////////////////////////////////////////
 
-int SearchThread::SuccessRate(Move mv)
+static void AddHistoryBonus(int& entry, int bonus)
 {
-	if (m_histTry[mv.To()][mv.Piece()] == 0)
-		return 0;
+	// gravity: the closer to the limit, the smaller the step towards it
+	entry += bonus - entry * abs(bonus) / HISTORY_MAX;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+static void AddHistoryBonus(I16& entry, int bonus)
+{
+	int value = entry;
+	AddHistoryBonus(value, bonus);
+	entry = static_cast<I16>(value);
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void SearchThread::UpdateCaptureHistory(Move best, const Move* captures, int numCaptures, int depth)
+{
+	//
+	//   Same scheme as UpdateHistory, best is null when a quiet move
+	//   refuted all the captures tried
+	//
+
+	int bonus = std::min(32 * depth * depth, HISTORY_BONUS_MAX);
+
+	for (int i = 0; i < numCaptures; ++i)
+	{
+		Move mv = captures[i];
+		AddHistoryBonus(m_captureHistory[mv.Piece()][mv.To()][mv.Captured()], -bonus);
+	}
+
+	if (!best.IsNull())
+		AddHistoryBonus(m_captureHistory[best.Piece()][best.To()][best.Captured()], bonus);
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void SearchThread::UpdateHistory(Move best, const Move* quiets, int numQuiets, int depth, Move lastMove, Move prevMove)
+{
+	//
+	//   Quiet move best caused a cutoff: it gets a bonus in every table,
+	//   the quiet moves searched before it get the same amount as a malus
+	//
+
+	int bonus = std::min(32 * depth * depth, HISTORY_BONUS_MAX);
+
+	for (int i = 0; i <= numQuiets; ++i)
+	{
+		Move mv = (i < numQuiets)? quiets[i] : best;
+		int delta = (i < numQuiets)? -bonus : bonus;
+
+		AddHistoryBonus(m_history[GetColor(mv.Piece())][mv.From()][mv.To()], delta);
+		if (!lastMove.IsNull())
+			AddHistoryBonus(m_contHistory[lastMove.Piece()][lastMove.To()][mv.Piece()][mv.To()], delta);
+		if (!prevMove.IsNull())
+			AddHistoryBonus(m_contHistory[prevMove.Piece()][prevMove.To()][mv.Piece()][mv.To()], delta);
+	}
 
-	double histTry = static_cast<double>(m_histTry[mv.To()][mv.Piece()]);
-	double histSuccess = static_cast<double>(m_histSuccess[mv.To()][mv.Piece()]);
-	return int(100 * histSuccess / histTry);
+	if (!lastMove.IsNull())
+		m_counterMoves[lastMove.Piece()][lastMove.To()] = best;
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -1333,20 +2650,19 @@ void SearchThread::UpdatePV(Move mv, int ply)
 	if (ply >= MAX_PLY)
 		return;
 
-	vector<Move>& pv = m_pvs[ply];
-	vector<Move>& child_pv = m_pvs[ply + 1];
+	int childLength = m_pvLength[ply + 1];
 
-	pv.clear();
-	pv.push_back(mv);
-	pv.insert(pv.end(), child_pv.begin(), child_pv.end());
+	m_pv[ply][0] = mv;
+	memcpy(&m_pv[ply][1], &m_pv[ply + 1][0], childLength * sizeof(Move));
+	m_pvLength[ply] = childLength + 1;
 }
 ////////////////////////////////////////////////////////////////////////////////
 
-void SearchThread::UpdateSortScores(MoveList& mvlist, Move hashMove, int ply, Move lastMove)
+void SearchThread::UpdateSortScores(MoveList& mvlist, Move hashMove, int ply, Move lastMove, Move prevMove)
 {
 	Move killerMove = m_killers[ply];
 	Move mateKillerMove = m_mateKillers[ply];
-	Move refutationMove = m_refutations[ply][lastMove.To()][lastMove.Piece()];
+	Move counterMove = m_counterMoves[lastMove.Piece()][lastMove.To()];
 
 	for (size_t j = 0; j < mvlist.Size(); ++j)
 	{
@@ -1355,33 +2671,30 @@ void SearchThread::UpdateSortScores(MoveList& mvlist, Move hashMove, int ply, Mo
 			mvlist[j].m_score = SORT_HASH;
 		else if (mv.Captured() || mv.Promotion())
 		{
-			int s_piece = mv.Piece() / 2;
+			//
+			//   Most valuable victim first, capture history instead of the
+			//   least valuable attacker inside a victim class. Captures that
+			//   lose material by SEE go after the quiet moves
+			//
+
 			int s_captured = mv.Captured() / 2;
 			int s_promotion = mv.Promotion() / 2;
-			mvlist[j].m_score = SORT_CAPTURE + 6 * (s_captured + s_promotion) - s_piece;
+			int value = 2 * HISTORY_MAX * (s_captured + s_promotion) +
+				m_captureHistory[mv.Piece()][mv.To()][mv.Captured()];
+
+			if (Search::SEE_GE(m_pos, mv, 0))
+				mvlist[j].m_score = SORT_CAPTURE + value;
+			else
+				mvlist[j].m_score = SORT_BAD_CAPTURE + value;
 		}
 		else if (mv == mateKillerMove)
 			mvlist[j].m_score = SORT_MATE_KILLER;
 		else if (mv == killerMove)
 			mvlist[j].m_score = SORT_KILLER;
-		else if (mv == refutationMove)
-			mvlist[j].m_score = SORT_REFUTATION;
+		else if (mv == counterMove)
+			mvlist[j].m_score = SORT_COUNTER;
 		else
-			mvlist[j].m_score = SORT_OTHER + SuccessRate(mv);
+			mvlist[j].m_score = SORT_OTHER + HistoryScore(mv, lastMove, prevMove);
 	}
 }
 ////////////////////////////////////////////////////////////////////////////////
-
-void SearchThread::Work()
-{
-	Log("Work(%d) called\n", m_id);
-
-#ifndef SINGLE_THREAD
-	std::lock_guard<std::mutex> lock(m_stateMutex);
-	m_state = THREAD_WORK;
-	m_cv.notify_one();
-#else
-	m_state = THREAD_WORK;
-#endif
-}
-////////////////////////////////////////////////////////////////////////////////
@@ -6,22 +6,37 @@
 #define SEARCH_H
 
 #ifndef SINGLE_THREAD
-#include <functional>
+#include <atomic>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #endif
 
+#include "eval.h"
 #include "position.h"
 #include "utils.h"
 
 const int MAX_PLY = 256;
+const int MAX_MULTIPV = 16;
+
+const int HISTORY_MAX = 16384;
+
+// hash depths of quiescence entries, below any main search depth
+const int HASH_DEPTH_QCHECKS = 0;    // captures and checks
+const int HASH_DEPTH_QS      = -1;   // captures only
+
+const int DEFAULT_ASPIRATION_DELTA  = 50;    // centipawns on each side
+const int DEFAULT_ASPIRATION_GROWTH = 200;   // percent per failure
+const int DEFAULT_RAZOR_MARGIN      = 150;   // centipawns per ply
+const int DEFAULT_PROBCUT_MARGIN    = 150;   // centipawns above beta
 
 struct SearchParams
 {
 	SearchParams() :
 		analysis(false),
 		silent(false),
+		adaptiveTime(false),
+		deterministic(true),
 		limitDepth(false),
 		limitNodes(false),
 		limitTime(true),
@@ -31,11 +46,17 @@ struct SearchParams
 		maxTimeHard(2000),
 		maxTimeSoft(2000),
 		maxKnps(0.0),
-		multipv(1)
+		multipv(1),
+		aspirationDelta(DEFAULT_ASPIRATION_DELTA),
+		aspirationGrowth(DEFAULT_ASPIRATION_GROWTH),
+		razorMargin(DEFAULT_RAZOR_MARGIN),
+		probCutMargin(DEFAULT_PROBCUT_MARGIN)
 	{}
 
 	bool  analysis;
 	bool  silent;
+	bool  adaptiveTime;   // maxTimeSoft is a target, adjusted by the search
+	bool  deterministic;  // reproducible multi-threaded search under a node limit
 
 	bool  limitDepth;
 	bool  limitNodes;
@@ -48,6 +69,10 @@ struct SearchParams
 	U32    maxTimeSoft;
 	double maxKnps;
 	int    multipv;
+	int    aspirationDelta;
+	int    aspirationGrowth;
+	int    razorMargin;
+	int    probCutMargin;
 };
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -55,6 +80,57 @@ struct SearchResults
 {
 	Move         bestMove;
 	int          depth;
+	EVAL         score;
+	U64          stopTime;   // arrival of the command that stopped the search
+};
+////////////////////////////////////////////////////////////////////////////////
+
+struct SearchStats
+{
+	//
+	//   Event counters of one search thread, plain integers: each thread
+	//   writes its own, they are summed after the helpers are parked
+	//
+
+	SearchStats() { Clear(); }
+
+	void Add(const SearchStats& other);
+	void Clear() { memset(this, 0, sizeof(SearchStats)); }
+
+	NODES betaCutoffs;
+	NODES firstMoveCutoffs;
+	NODES nullMoveTries;
+	NODES nullMoveCutoffs;
+	NODES lmrReductions;
+	NODES lmrResearches;
+	NODES futilityPrunes;
+	NODES razorPrunes;
+	NODES lateMovePrunes;
+	NODES seeQuietPrunes;
+	NODES probCuts;
+	NODES multiCuts;
+	NODES extensions;
+	NODES singularExtensions;
+	NODES qNodes;
+	NODES qProbes;
+	NODES qHits;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+struct RootMove
+{
+	RootMove(Move mv = Move()) :
+		m_mv(mv),
+		m_score(-INFINITY_SCORE),
+		m_depth(0),
+		m_nodes(0)
+	{}
+
+	Move         m_mv;
+	EVAL         m_score;   // -INFINITY_SCORE unless searched above the bound
+	int          m_depth;
+	NODES        m_nodes;   // subtree size in the last root search
+	vector<Move> m_pv;
 };
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -114,110 +190,227 @@ private:
 };
 ////////////////////////////////////////////////////////////////////////////////
 
-enum ThreadState
+struct ShardEntry
 {
-	THREAD_NEW   = 0,
-	THREAD_SLEEP = 1,
-	THREAD_WORK  = 2,
-	THREAD_QUIT  = 3
+	U64       m_hash;   // full key, to find the slot of the shared table
+	HashEntry m_entry;
 };
+////////////////////////////////////////////////////////////////////////////////
 
-class SearchThread
+const int CACHE_LINE_SIZE = 64;
+
+class NodeCounter
 {
 public:
-	SearchThread() :
-		m_id(0),
-		m_state(THREAD_NEW) {}
-	~SearchThread()
-	{
+	//
+	//   Written by its own thread only and summed by the main thread, so a
+	//   relaxed load/store pair is enough; the padding keeps neighbouring
+	//   counters of other threads off this cache line
+	//
+
+	NodeCounter() : m_value(0) {}
+
 #ifndef SINGLE_THREAD
-		if (m_thread.joinable())
-			m_thread.join();
+	NODES Get() const { return m_value.load(std::memory_order_relaxed); }
+	void  Inc() { m_value.store(Get() + 1, std::memory_order_relaxed); }
+	void  Reset() { m_value.store(0, std::memory_order_relaxed); }
+#else
+	NODES Get() const { return m_value; }
+	void  Inc() { ++m_value; }
+	void  Reset() { m_value = 0; }
 #endif
-	}
 
-	EVAL AlphaBeta(const EVAL alpha, const EVAL beta, const int depth, const int ply);
+private:
+#ifndef SINGLE_THREAD
+	typedef std::atomic<NODES> Value;
+#else
+	typedef NODES Value;
+#endif
+
+	char  m_pad0[CACHE_LINE_SIZE];
+	Value m_value;
+	char  m_pad1[CACHE_LINE_SIZE - sizeof(Value)];
+};
+////////////////////////////////////////////////////////////////////////////////
+
+class SearchThread
+{
+public:
+	SearchThread() :
+		m_failHigh(0),
+		m_failLow(0),
+		m_completedDepth(0),
+		m_completedScore(0),
+		m_id(0),
+		m_multiPV(1),
+		m_nextTimeCheck(0),
+		m_nodeLimit(0),
+		m_outOfNodes(false),
+		m_stepDepth(1),
+		m_stepAlpha(-INFINITY_SCORE),
+		m_stepBeta(INFINITY_SCORE),
+		m_stepDelta(0),
+		m_shardMask(0) {}
+	EVAL AlphaBeta(EVAL alpha, const EVAL beta, const int depth, const int ply);
+	bool AspirationResult(EVAL score, EVAL& alpha, EVAL& beta, EVAL& delta);
 	EVAL AlphaBetaQ(const EVAL alpha, const EVAL beta, const int ply, const int qply);
+	double BestMoveShare() const;
 	void CheckInput(bool force = false);
 	void CheckLimits();
-	void ClearExcludedMoves() { m_exclude.clear(); }
-	void ExcludeMove(Move mv) { m_exclude.push_back(mv); }
-	void Init(int id);
+	void ClearHistory();
+	static void HelperMain(int id);
+	int  Id() const { return m_id; }
+	void MergeShard();
 	void NewSearch(const Position& pos);
+	bool OutOfNodes() const { return m_outOfNodes; }
+	void PrepareShard(size_t size);
+#ifdef SINGLE_THREAD
 	void ProcessInput(const string& s);
+#endif
+	vector<Move> RootPV() const { return vector<Move>(m_pv[0], m_pv[0] + m_pvLength[0]); }
+	void SetNodeBudget(NODES budget);
 	void Stop();
-	bool Stopped() const { return m_state != THREAD_WORK; }
-	void Work();
-	void Quit();
+	bool Stopped() const;
 
-	NODES        m_nodes;
-	vector<Move> m_pvs[MAX_PLY + 1];
+	NodeCounter  m_nodes;
+	vector<RootMove> m_rootMoves;   // best first after each root search
 	int          m_selDepth;
 
+	// root re-searches after the aspiration window failed
+	int          m_failHigh;
+	int          m_failLow;
+
+	SearchStats  m_stats;
+
+	// last iteration finished inside the window, for best-thread selection
+	int          m_completedDepth;
+	EVAL         m_completedScore;
+	vector<Move> m_completedPV;
+
 private:
-	void ClearHistory();
-	void ClearKillersAndRefutations();
+	void ClearKillers();
 	Move GetNextBest(MoveList& mvlist, size_t i);
-	int  SuccessRate(Move mv);
+	int  HistoryScore(Move mv, Move lastMove, Move prevMove) const;
+	HashEntry* ProbeHash(const Position& pos);
+	void RecordHash(const Position& pos, Move mv, EVAL score, int depth, int ply, U8 hashType);
+	EVAL RootBound(size_t searched, EVAL alpha) const;
+	void SearchStep();
+	void UpdateCaptureHistory(Move best, const Move* captures, int numCaptures, int depth);
+	void UpdateHistory(Move best, const Move* quiets, int numQuiets, int depth, Move lastMove, Move prevMove);
 	void UpdatePV(Move mv, int ply);
-	void UpdateSortScores(MoveList& mvlist, Move hashMove, int ply, Move lastMove);
+	void UpdateSortScores(MoveList& mvlist, Move hashMove, int ply, Move lastMove, Move prevMove);
+
+	//
+	//   Quiet move statistics, kept for the whole game: butterfly history
+	//   by side and squares, continuation history by the (piece, to) of
+	//   the move one or two plies back, counter moves by the last move.
+	//   Captures and promotions have their own table by piece, target
+	//   square and captured piece
+	//
+
+	int          m_history[2][64][64];
+	I16          m_contHistory[14][64][14][64];
+	I16          m_captureHistory[14][64][14];
+	Move         m_counterMoves[14][64];
+
+	PawnHashTable m_pawnHash;
 
-	vector<Move> m_exclude;
-	int          m_histTry[64][14];
-	int          m_histSuccess[64][14];
 	int          m_id;
+	int          m_multiPV;
+	Move         m_excluded[MAX_PLY + 1];   // skipped by the singular test search at this ply
+	EVAL         m_evalStack[MAX_PLY + 1];  // static eval by ply, -INFINITY_SCORE when in check
 	Move         m_killers[MAX_PLY + 1];
 	Move         m_mateKillers[MAX_PLY + 1];
 	MoveList     m_mvlists[MAX_PLY + 1];
+	NODES        m_nextTimeCheck;
+	Move         m_pv[MAX_PLY + 1][MAX_PLY + 1];   // triangular: row ply holds the line from ply
+	int          m_pvLength[MAX_PLY + 2];
 	Position     m_pos;
-	Move         m_refutations[MAX_PLY + 1][64][14];
-	ThreadState  m_state;
 
-	void HelperProc();
+	//
+	//   Deterministic mode: a node budget per round, the helper's own
+	//   iteration schedule carried from round to round, and a private
+	//   table for hash writes that is merged into the shared one when
+	//   all threads have stopped
+	//
 
-#ifndef SINGLE_THREAD
-	std::condition_variable m_cv;
-	std::mutex              m_posMutex;
-	std::mutex              m_stateMutex;
-	std::thread             m_thread;
-#endif
+	NODES        m_nodeLimit;
+	bool         m_outOfNodes;
+	int          m_stepDepth;
+	EVAL         m_stepAlpha;
+	EVAL         m_stepBeta;
+	EVAL         m_stepDelta;
+	vector<ShardEntry> m_hashShard;
+	vector<U32>  m_shardUsed;   // slots in the order they were first written
+	U64          m_shardMask;
+
+	void HelperProc();
 };
 ////////////////////////////////////////////////////////////////////////////////
 
-const int MAX_NUM_THREADS = 16;
+const int MAX_NUM_THREADS = 512;
 
 class Search
 {
 public:
 	static void       ClearHash();
+	static void       ClearHistory();
 	static int        CurrentIteration() { return s_iter; }
 	static U64        CurrentSearchTime();
 	static Move       GetRandomMove(Position& pos);
 	static void       InitThreads(int numThreads);
+	static void       PrintStats();
 	static bool       IsGameOver(Position& pos, string& result, string& comment);
+	static int        NumThreads() { return s_numThreads; }
 	static HashEntry* ProbeHash(const Position& pos);
 	static void       QuitThreads();
 	static void       RecordHash(const Position& pos, Move mv, EVAL score, int depth, int ply, U8 hashType);
+	static void       RecordHash(HashEntry& entry, U64 hash, Move mv, EVAL score, int depth, int ply, U8 hashType);
+	static bool       KeepHashEntry(const HashEntry& entry, int depth);
 	static EVAL       SEE(const Position& pos, Move mv);
+	static bool       SEE_GE(const Position& pos, Move mv, EVAL threshold);
+	static void       SetHashInterleave(bool on);
 	static void       SetHashSize(double mb);
 	static void       SetStrength(int level);
+	static void       SetThreadAffinity(bool on);
+	static bool       ThreadAffinity() { return s_threadAffinity; }
 	static void       StartPerft(Position& pos, int depth);
 	static void       StartSearch(const Position& pos);
+	static NODES      TotalNodes();
+#ifndef SINGLE_THREAD
+	static bool       StopRequested() { return s_stop.load(std::memory_order_relaxed); }
+	static void       RequestStop() { s_stop.store(true); }   // ordered with the input thread, see InputInterrupted()
+#else
+	static bool       StopRequested() { return s_stop; }
+	static void       RequestStop() { s_stop = true; }
+#endif
 
 	static SearchParams  s_params;
 	static SearchResults s_results;
 
 private:
 	static int        CountLegalMoves(Position& pos, const MoveList& mvlist, int upperLimit);
+	static bool       DeterministicBarrier();
+	static void       DeterministicRelease();
+	static void       MergeHash(U64 hash, const HashEntry& entry);
 	static NODES      Perft(Position& pos, int depth, int ply);
-	static void       PrintPV(int multipv);
-	static EVAL       SEE_Exchange(const Position& pos, FLD f, COLOR side, EVAL score, EVAL target, U64 occ);
+	static const SearchThread* PickBestThread();
+	static void       PrintPV(const SearchThread& thread, const vector<Move>& pv, int depth, EVAL score, int multipv);
+	static void       PrintThreadStats();
+	static void       ReleaseHelpers(bool start);
+	static void       SendTelemetry(int depth, EVAL score, U64 time);
+	static bool       TimeToStop(U64 time, U64 iterTime, U64 prevIterTime, bool bestMoveChanged, EVAL scoreDrop);
+	static void       WaitHelpers();
+	static bool       WaitWork(U32& generation);
+	static U64        SEE_Attackers(const Position& pos, FLD f, U64 occ, U64 bishops, U64 rooks);
+	static PIECE      SEE_LeastAttacker(const Position& pos, U64 attackers, COLOR side);
 
 	static EVAL          s_alpha;
 	static EVAL          s_beta;
 	static HashEntry*    s_hash;
 	static U8            s_hashAge;
 	static size_t        s_hashFull;
+	static bool          s_hashInterleave;
 	static size_t        s_hashSize;
 	static U64           s_hashMask;
 	static int           s_iter;
@@ -225,8 +418,40 @@ private:
 	static Position      s_pos;
 	static EVAL          s_score;
 	static U64           s_startTime;
-	static SearchThread  s_threads[MAX_NUM_THREADS];
+	static bool          s_threadAffinity;
+	static double        s_instability;
+	static bool          s_deterministic;   // set for the current search
+	static size_t        s_shardSize;       // entries in each thread's shard for the current search
+	static vector<NODES> s_iterNodes;   // total nodes after each completed iteration
+
+	//
+	//   Helper pool: helpers sleep until the generation changes, search
+	//   until s_stop is raised, then count themselves out of s_busy
+	//
+
+	static U32               s_generation;
+	static int               s_busy;
+	static bool              s_quit;
+#ifndef SINGLE_THREAD
+	static std::atomic<bool>       s_stop;
+	static std::mutex              s_poolMutex;
+	static std::condition_variable s_poolCv;
+	static std::condition_variable s_doneCv;
+	static vector<std::thread>     s_helpers;
+#else
+	static bool                    s_stop;
+#endif
+
+	static vector<SearchThread*> s_threads;
+
+	friend class SearchThread;
 };
 ////////////////////////////////////////////////////////////////////////////////
 
+inline bool SearchThread::Stopped() const
+{
+	return m_outOfNodes || Search::StopRequested();
+}
+////////////////////////////////////////////////////////////////////////////////
+
 #endif
@@ -141,6 +141,25 @@ struct Pair
 };
 ////////////////////////////////////////////////////////////////////////////////
 
+//   Integer counterpart of Pair, used for incrementally updated scores
+//   where exact add/subtract matters more than fractional weights
+
+struct IntPair
+{
+	IntPair() : mid(0), end(0) {}
+	IntPair(I32 mid_, I32 end_) :
+		mid(mid_),
+		end(end_)
+	{}
+
+	void operator+= (const IntPair& other) { mid += other.mid; end += other.end; }
+	void operator-= (const IntPair& other) { mid -= other.mid; end -= other.end; }
+
+	I32 mid;
+	I32 end;
+};
+////////////////////////////////////////////////////////////////////////////////
+
 inline Pair operator+ (const Pair& lhs, const Pair& rhs)
 {
 	return Pair(lhs.mid + rhs.mid, lhs.end + rhs.end);
@@ -7,12 +7,178 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/types.h>
 #include <signal.h>
+
+#ifndef SINGLE_THREAD
+#include <mutex>
+#endif
+
 #include "utils.h"
 
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
 static int g_pipe = 0;
 
+#ifdef __linux__
+
+//
+//   CPU order for pinning search threads: one CPU per NUMA node in turn,
+//   physical cores before their hyperthread siblings
+//
+
+static vector<int> g_cpuOrder;
+static vector<int> g_memNodes;
+
+static void ParseCpuList(const string& s, vector<int>& out)
+{
+	vector<string> ranges;
+	Split(s, ranges, ",");
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		int first = 0, last = 0;
+		int n = sscanf(ranges[i].c_str(), "%d-%d", &first, &last);
+		if (n < 1)
+			continue;
+		if (n < 2)
+			last = first;
+		for (int cpu = first; cpu <= last; ++cpu)
+			out.push_back(cpu);
+	}
+}
+
+static string ReadSysFile(const string& path)
+{
+	ifstream ifs(path.c_str());
+	string s;
+	if (ifs.good())
+		getline(ifs, s);
+	return s;
+}
+
+static void ReadTopologyOnce()
+{
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+		return;
+
+	vector<int> nodeIds;
+	ParseCpuList(ReadSysFile("/sys/devices/system/node/online"), nodeIds);
+	if (nodeIds.empty())
+		nodeIds.push_back(-1);
+
+	vector<vector<int> > nodeCpus;
+	for (size_t i = 0; i < nodeIds.size(); ++i)
+	{
+		vector<int> cpus;
+		if (nodeIds[i] >= 0)
+		{
+			stringstream path;
+			path << "/sys/devices/system/node/node" << nodeIds[i] << "/cpulist";
+			ParseCpuList(ReadSysFile(path.str()), cpus);
+		}
+		else
+		{
+			for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+				cpus.push_back(cpu);
+		}
+
+		vector<int> primary, secondary;
+		for (size_t j = 0; j < cpus.size(); ++j)
+		{
+			int cpu = cpus[j];
+			if (cpu < 0 || cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed))
+				continue;
+
+			stringstream path;
+			path << "/sys/devices/system/cpu/cpu" << cpu << "/topology/thread_siblings_list";
+			vector<int> siblings;
+			ParseCpuList(ReadSysFile(path.str()), siblings);
+
+			if (siblings.empty() || siblings[0] == cpu)
+				primary.push_back(cpu);
+			else
+				secondary.push_back(cpu);
+		}
+		primary.insert(primary.end(), secondary.begin(), secondary.end());
+
+		if (!primary.empty())
+		{
+			nodeCpus.push_back(primary);
+			if (nodeIds[i] >= 0)
+				g_memNodes.push_back(nodeIds[i]);
+		}
+	}
+
+	for (size_t j = 0; ; ++j)
+	{
+		bool added = false;
+		for (size_t i = 0; i < nodeCpus.size(); ++i)
+		{
+			if (j < nodeCpus[i].size())
+			{
+				g_cpuOrder.push_back(nodeCpus[i][j]);
+				added = true;
+			}
+		}
+		if (!added)
+			break;
+	}
+
+	Log("TOPOLOGY: %d NUMA node(s), %d CPU(s)\n", (int)nodeCpus.size(), (int)g_cpuOrder.size());
+}
+
+static void ReadTopology()
+{
+	// helpers started together all get here before pinning themselves
+#ifndef SINGLE_THREAD
+	static std::once_flag topologyRead;
+	std::call_once(topologyRead, ReadTopologyOnce);
+#else
+	static bool topologyRead = false;
+	if (!topologyRead)
+	{
+		topologyRead = true;
+		ReadTopologyOnce();
+	}
+#endif
+}
+
+#endif
+
+bool BindThreadToCPU(int index)
+{
+#ifdef __linux__
+	ReadTopology();
+	if (g_cpuOrder.size() < 2)
+		return false;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(g_cpuOrder[index % g_cpuOrder.size()], &set);
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
+
+U64 GetMonotonicTime()
+{
+	//
+	//   Milliseconds since an arbitrary point; CLOCK_MONOTONIC is served
+	//   from the vDSO, so no system call is made
+	//
+
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000 * static_cast<U64>(ts.tv_sec) + ts.tv_nsec / 1000000;
+}
+
 U64 GetProcTime()
 {
 	timeval tv;
@@ -78,6 +244,51 @@ bool InputAvailable()
 	return 0;
 }
 
+bool InterleaveMemory(void* p, size_t size, bool on)
+{
+#ifdef __linux__
+	//
+	//   mbind(2) through syscall(), so that no libnuma is needed;
+	//   pages already in place are migrated (MPOL_MF_MOVE)
+	//
+
+	ReadTopology();
+	if (g_memNodes.size() < 2)
+		return false;
+
+	const int MPOL_DEFAULT = 0;
+	const int MPOL_INTERLEAVE = 3;
+	const unsigned MPOL_MF_MOVE = 1 << 1;
+	const int MAX_NODES = 1024;
+
+	unsigned long mask[MAX_NODES / (8 * sizeof(unsigned long))];
+	memset(mask, 0, sizeof(mask));
+	for (size_t i = 0; i < g_memNodes.size(); ++i)
+	{
+		int node = g_memNodes[i];
+		if (node < MAX_NODES)
+			mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+	}
+
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t begin = ((size_t)p + pageSize - 1) & ~(pageSize - 1);
+	size_t end = ((size_t)p + size) & ~(pageSize - 1);
+	if (end <= begin)
+		return false;
+
+	long r = syscall(SYS_mbind, begin, end - begin,
+		on? MPOL_INTERLEAVE : MPOL_DEFAULT,
+		on? mask : NULL,
+		on? MAX_NODES + 1 : 0,
+		MPOL_MF_MOVE);
+
+	Log("INTERLEAVE: %d MB on %d nodes, result = %d\n", (int)(size >> 20), (int)g_memNodes.size(), (int)r);
+	return r == 0;
+#else
+	return false;
+#endif
+}
+
 bool IsPipe()
 {
 	return g_pipe != 0;
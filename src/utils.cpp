@@ -3,6 +3,14 @@
 //   http://greko.su
 
 #include <stdarg.h>
+
+#ifndef SINGLE_THREAD
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
 #include "bitboards.h"
 #include "utils.h"
 
@@ -10,6 +18,123 @@ extern FILE* g_log;
 
 U64 g_rand64 = 42;
 
+static U64 g_lastInputTime = 0;
+
+#ifndef SINGLE_THREAD
+
+//
+//   Lines typed by the user or sent by the GUI are read by a dedicated
+//   thread and passed to the command loop through a lock-free ring.
+//   Lines that must interrupt a search are marked by number as they
+//   arrive, so the search only compares two counters and never sees
+//   the commands themselves
+//
+
+struct InputLine
+{
+	string text;
+	U64    time;
+	U64    number;
+};
+
+template <typename T, size_t N>
+class SpscQueue
+{
+public:
+	SpscQueue() : m_head(0), m_tail(0) {}
+
+	bool Empty() const
+	{
+		return m_head.load(std::memory_order_relaxed) == m_tail.load(std::memory_order_acquire);
+	}
+
+	bool Push(const T& x)
+	{
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		size_t next = (tail + 1) % N;
+		if (next == m_head.load(std::memory_order_acquire))
+			return false;
+		m_items[tail] = x;
+		m_tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	bool Pop(T& x)
+	{
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire))
+			return false;
+		x = m_items[head];
+		m_head.store((head + 1) % N, std::memory_order_release);
+		return true;
+	}
+
+private:
+	T                   m_items[N];
+	std::atomic<size_t> m_head;   // written by consumer
+	char                m_pad[64];
+	std::atomic<size_t> m_tail;   // written by producer
+};
+
+static SpscQueue<InputLine, 256> g_input;
+static std::atomic<bool>         g_inputEof(false);
+static std::mutex                g_inputMutex;
+static std::condition_variable   g_inputCv;
+static std::thread               g_inputThread;
+
+static InputFilter               g_inputFilter = NULL;
+static void                    (*g_inputInterrupt)() = NULL;
+static std::atomic<U64>          g_interruptLine(0);   // number of the last interrupting line
+static std::atomic<U64>          g_interruptTime(0);
+static U64                       g_takenLine = 0;      // last line handed to the command loop
+static std::atomic<bool>         g_searching(false);
+
+static void Interrupt(const InputLine& line)
+{
+	// the line number first: a search starting meanwhile finds it even if it clears the stop flag
+	g_interruptTime.store(line.time, std::memory_order_relaxed);
+	g_interruptLine.store(line.number);
+	if (g_inputInterrupt != NULL)
+		g_inputInterrupt();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+static void InputProc()
+{
+	InputLine line;
+	line.number = 0;
+
+	while (getline(cin, line.text))
+	{
+		line.time = GetMonotonicTime();
+		++line.number;
+
+		int action = (g_inputFilter != NULL)? g_inputFilter(line.text) : INPUT_QUEUE;
+		if (action == INPUT_DONE)
+			continue;
+		if (action == INPUT_INTERRUPT)
+			Interrupt(line);
+
+		while (!g_input.Push(line))
+			SleepMillisec(1);
+
+		// the lock only orders this wakeup against a consumer going to sleep
+		std::lock_guard<std::mutex> lock(g_inputMutex);
+		g_inputCv.notify_one();
+	}
+
+	// end of input stops a search like quit does
+	line.time = GetMonotonicTime();
+	++line.number;
+	Interrupt(line);
+
+	std::lock_guard<std::mutex> lock(g_inputMutex);
+	g_inputEof = true;
+	g_inputCv.notify_one();
+}
+
+#endif
+
 string CurrentDateStr()
 {
 	time_t t = time(0);   // get time now
@@ -20,12 +145,67 @@ string CurrentDateStr()
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+bool InputInterrupted()
+{
+	//
+	//   True when a line that stops the search has arrived after the one
+	//   being executed
+	//
+
+#ifndef SINGLE_THREAD
+	return g_interruptLine.load() > g_takenLine;
+#else
+	return false;
+#endif
+}
+////////////////////////////////////////////////////////////////////////////////
+
+U64 InterruptTime()
+{
+#ifndef SINGLE_THREAD
+	return g_interruptTime.load(std::memory_order_relaxed);
+#else
+	return 0;
+#endif
+}
+////////////////////////////////////////////////////////////////////////////////
+
 bool Is(const string& cmd, const string& pattern, size_t minLen)
 {
 	return (pattern.find(cmd) == 0 && cmd.length() >= minLen);
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+U64 LastInputTime()
+{
+	return g_lastInputTime;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+bool PollInput(string& s)
+{
+	//
+	//   Non-blocking: takes the next line if one has arrived
+	//
+
+#ifndef SINGLE_THREAD
+	InputLine line;
+	if (!g_input.Pop(line))
+		return false;
+	s = line.text;
+	g_lastInputTime = line.time;
+	g_takenLine = line.number;
+	return true;
+#else
+	if (!InputAvailable())
+		return false;
+	getline(cin, s);
+	g_lastInputTime = GetMonotonicTime();
+	return true;
+#endif
+}
+////////////////////////////////////////////////////////////////////////////////
+
 U32 Rand32()
 {
 	return U32(Rand64() >> 32);
@@ -99,6 +279,45 @@ void Split(const string& s, vector<string>& tokens, const string& sep)
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+bool Searching()
+{
+#ifndef SINGLE_THREAD
+	return g_searching;
+#else
+	return false;
+#endif
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void SetSearching(bool on)
+{
+#ifndef SINGLE_THREAD
+	g_searching = on;
+#else
+	(void)on;
+#endif
+}
+////////////////////////////////////////////////////////////////////////////////
+
+void StartInputThread(InputFilter filter, void (*interrupt)())
+{
+	//
+	//   filter runs on the input thread for every line, interrupt is
+	//   called there after a line the filter marked INPUT_INTERRUPT
+	//
+
+#ifndef SINGLE_THREAD
+	g_inputFilter = filter;
+	g_inputInterrupt = interrupt;
+	g_inputThread = std::thread(InputProc);
+	g_inputThread.detach();
+#else
+	(void)filter;
+	(void)interrupt;
+#endif
+}
+////////////////////////////////////////////////////////////////////////////////
+
 string Timestamp()
 {
 	time_t t = time(0);   // get time now
@@ -108,3 +327,22 @@ string Timestamp()
 	return string(buf);
 }
 ////////////////////////////////////////////////////////////////////////////////
+
+bool WaitInput(string& s)
+{
+	//
+	//   Blocking: returns false when the input is closed
+	//
+
+#ifndef SINGLE_THREAD
+	std::unique_lock<std::mutex> lock(g_inputMutex);
+	g_inputCv.wait(lock, [] { return !g_input.Empty() || g_inputEof; });
+	return PollInput(s);
+#else
+	if (!getline(cin, s))
+		return false;
+	g_lastInputTime = GetMonotonicTime();
+	return true;
+#endif
+}
+////////////////////////////////////////////////////////////////////////////////
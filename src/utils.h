@@ -7,21 +7,42 @@
 
 #include "types.h"
 
+// what the input thread does with a line, see StartInputThread()
+enum
+{
+	INPUT_QUEUE,       // left to the command loop
+	INPUT_INTERRUPT,   // stops a running search, then left to the command loop
+	INPUT_DONE         // handled by the filter itself
+};
+
+typedef int (*InputFilter)(const string& s);
+
+bool   BindThreadToCPU(int index);
 string CurrentDateStr();
+U64    GetMonotonicTime();
 U64    GetProcTime();
 void   Highlight(bool on);
 void   InitIO();
 bool   InputAvailable();
+bool   InputInterrupted();
+U64    InterruptTime();
+bool   InterleaveMemory(void* p, size_t size, bool on);
 bool   IsPipe();
 bool   Is(const string& cmd, const string& pattern, size_t minLen);
+U64    LastInputTime();
+bool   PollInput(string& s);
 U32    Rand32();
 U64    Rand64();
 U64    Rand64(int bits);
 double RandDouble();
 void   RandSeed(U64 seed);
+bool   Searching();
+void   SetSearching(bool on);
 void   SleepMillisec(int msec);
 void   Split(const string& s, vector<string>& tokens, const string& sep = " ");
+void   StartInputThread(InputFilter filter, void (*interrupt)());
 string Timestamp();
+bool   WaitInput(string& s);
 
 extern FILE* g_log;
 
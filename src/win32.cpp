@@ -9,6 +9,18 @@
 static int g_pipe = 0;
 static HANDLE g_handle = 0;
 
+bool BindThreadToCPU(int index)
+{
+	return false;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+U64 GetMonotonicTime()
+{
+	return GetTickCount();
+}
+////////////////////////////////////////////////////////////////////////////////
+
 U64 GetProcTime()
 {
 	return GetTickCount();
@@ -50,6 +62,12 @@ bool InputAvailable()
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+bool InterleaveMemory(void* p, size_t size, bool on)
+{
+	return false;
+}
+////////////////////////////////////////////////////////////////////////////////
+
 bool IsPipe()
 {
 	return g_pipe != 0;